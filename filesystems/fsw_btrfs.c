@@ -47,6 +47,8 @@
 #define grub_off_t int32_t
 #define grub_size_t int32_t
 #define grub_ssize_t int32_t
+/* pointer-sized, as in grub */
+#define grub_addr_t unsigned long
 #include "crc32c.c"
 #include "gzio.c"
 #define MINILZO_CFG_SKIP_LZO_PTR 1
@@ -1861,6 +1863,11 @@ out:
 // Dispatch Table
 //
 
+// the primary superblock at 64 KiB must be valid; its signature is at offset 0x40
+static const struct fsw_signature fsw_btrfs_signatures[] = {
+    { 64 * 1024 + 0x40, sizeof(GRUB_BTRFS_SIGNATURE) - 1, GRUB_BTRFS_SIGNATURE },
+};
+
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(btrfs) = {
     { FSW_STRING_TYPE_UTF8, 5, 5, "btrfs" },
     sizeof(struct fsw_btrfs_volume),
@@ -1876,5 +1883,7 @@ struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(btrfs) = {
     fsw_btrfs_dir_lookup,
     fsw_btrfs_dir_read,
     fsw_btrfs_readlink,
+    fsw_btrfs_signatures,
+    sizeof(fsw_btrfs_signatures) / sizeof(fsw_btrfs_signatures[0]),
 };
 
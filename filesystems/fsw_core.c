@@ -692,6 +692,61 @@ fsw_status_t fsw_dnode_dir_read(struct fsw_shandle *shand, struct fsw_dnode **ch
     return status;
 }
 
+/**
+ * Get the next batch of directory items in sequential order. This function is called
+ * by the host driver as a faster alternative to calling fsw_dnode_dir_read for every
+ * entry. It reads up to max_count entries (at most FSW_DIR_BATCH_MAX) into child_dnos,
+ * in the same order fsw_dnode_dir_read would return them, and then fills the new
+ * dnodes in ascending order of their dnode_id. On file systems that keep inodes in
+ * tables, that order walks the inode tables from front to back, so inodes sharing a
+ * block are read together and the block cache isn't thrashed by interleaving
+ * directory blocks with scattered inode blocks.
+ *
+ * Errors while filling a dnode are ignored here; they surface again when the caller
+ * fills or stats that dnode. If reading the directory fails after some entries have
+ * been collected, those entries are returned and the error is reported by the next
+ * call.
+ *
+ * When the end of the directory is reached, this function returns FSW_NOT_FOUND.
+ * If the function returns FSW_SUCCESS, *count_out is at least 1 and the caller must
+ * call fsw_dnode_release on each of the returned dnodes.
+ */
+
+fsw_status_t fsw_dnode_dir_read_batch(struct fsw_shandle *shand, struct fsw_dnode **child_dnos,
+                                      fsw_u32 max_count, fsw_u32 *count_out)
+{
+    fsw_status_t    status = FSW_SUCCESS;
+    struct fsw_dnode *fill_order[FSW_DIR_BATCH_MAX];
+    struct fsw_dnode *child_dno;
+    fsw_u32         count, i, j;
+
+    if (max_count > FSW_DIR_BATCH_MAX)
+        max_count = FSW_DIR_BATCH_MAX;
+
+    // collect the names first, so the directory blocks are read back to back
+    for (count = 0; count < max_count; count++) {
+        status = fsw_dnode_dir_read(shand, &child_dnos[count]);
+        if (status)
+            break;
+    }
+    *count_out = count;
+    if (count == 0)
+        return status;
+
+    // sort by dnode_id (insertion sort; the batch is small)
+    for (i = 0; i < count; i++) {
+        child_dno = child_dnos[i];
+        for (j = i; j > 0 && fill_order[j - 1]->dnode_id > child_dno->dnode_id; j--)
+            fill_order[j] = fill_order[j - 1];
+        fill_order[j] = child_dno;
+    }
+
+    for (i = 0; i < count; i++)
+        fsw_dnode_fill(fill_order[i]);
+
+    return FSW_SUCCESS;
+}
+
 /**
  * Read the target path of a symbolic link. This function is called by the host driver
  * to read the "content" of a symbolic link, that is the relative or absolute path
@@ -56,6 +56,9 @@
 /** Indicates that the block cache entry is empty. */
 #define FSW_INVALID_BNO 0xFFFFFFFFFFFFFFFF
 
+/** Maximum number of entries returned by one fsw_dnode_dir_read_batch call. */
+#define FSW_DIR_BATCH_MAX (64)
+
 
 //
 // Byte-swapping macros
@@ -347,6 +350,19 @@ struct fsw_host_table
     fsw_status_t (*read_block)(struct fsw_volume *vol, fsw_u64 phys_bno, void *buffer);
 };
 
+/**
+ * Core: A magic value at a fixed byte offset from the start of the device.
+ * Hosts may check these before calling volume_mount to cheaply reject
+ * devices that cannot hold the file system.
+ */
+
+struct fsw_signature
+{
+    fsw_u64     offset;             //!< Byte offset of the magic value on the device
+    fsw_u32     length;             //!< Length of the magic value in bytes
+    const char  *magic;             //!< Bytes that must be present at offset
+};
+
 /**
  * Core: Function table for a file system driver.
  */
@@ -374,6 +390,9 @@ struct fsw_fstype_table
                              struct fsw_shandle *shand, struct DNODESTRUCTNAME **child_dno);
     fsw_status_t (*readlink)(struct VOLSTRUCTNAME *vol, struct DNODESTRUCTNAME *dno,
                              struct fsw_string *link_target);
+
+    const struct fsw_signature *signatures; //!< Superblock signatures, any of which may match (optional)
+    fsw_u32     signature_count;    //!< Number of entries in signatures; 0 skips the pre-check
 };
 
 
@@ -419,6 +438,8 @@ fsw_status_t fsw_dnode_lookup_path(struct fsw_dnode *dno,
                                    struct fsw_string *lookup_path, char separator,
                                    struct fsw_dnode **child_dno_out);
 fsw_status_t fsw_dnode_dir_read(struct fsw_shandle *shand, struct fsw_dnode **child_dno_out);
+fsw_status_t fsw_dnode_dir_read_batch(struct fsw_shandle *shand, struct fsw_dnode **child_dnos,
+                                     fsw_u32 max_count, fsw_u32 *count_out);
 fsw_status_t fsw_dnode_readlink(struct fsw_dnode *dno, struct fsw_string *link_target);
 fsw_status_t fsw_dnode_readlink_data(struct DNODESTRUCTNAME *dno, struct fsw_string *link_target);
 fsw_status_t fsw_dnode_resolve(struct fsw_dnode *dno, struct fsw_dnode **target_dno_out);
@@ -45,6 +45,7 @@
 #include "edk2/ComponentName.h"
 #endif
 #include "../include/refit_call_wrapper.h"
+#include "../include/FswFileInfo.h"
 
 #define DEBUG_LEVEL 0
 
@@ -132,6 +133,7 @@ EFI_STATUS fsw_efi_dir_read(IN FSW_FILE_DATA *File,
                             OUT VOID *Buffer);
 EFI_STATUS fsw_efi_dir_setpos(IN FSW_FILE_DATA *File,
                               IN UINT64 Position);
+static VOID fsw_efi_dir_release_batch(IN FSW_FILE_DATA *File);
 
 EFI_STATUS fsw_efi_dnode_getinfo(IN FSW_FILE_DATA *File,
                                  IN EFI_GUID *InformationType,
@@ -263,11 +265,44 @@ EFI_STATUS EFIAPI fsw_efi_main(IN EFI_HANDLE         ImageHandle,
 EFI_DRIVER_ENTRY_POINT(fsw_efi_main)
 #endif
 
+/** Longest superblock signature fsw_efi_match_signature() will compare. */
+#define FSW_SIGNATURE_MAX 16
+
+/**
+ * Check the file system's superblock signatures, if it declares any, with one
+ * small read each. Returns TRUE if any signature matches, or if there are no
+ * signatures to check, so that only plausible devices are handed to fsw_mount().
+ */
+
+static BOOLEAN fsw_efi_match_signature(IN EFI_DISK_IO *DiskIo, IN UINT32 MediaId)
+{
+    struct fsw_fstype_table *fstype = &FSW_FSTYPE_TABLE_NAME(FSTYPE);
+    const struct fsw_signature *sig;
+    UINT8               Buffer[FSW_SIGNATURE_MAX];
+    fsw_u32             i;
+
+    if (fstype->signatures == NULL || fstype->signature_count == 0)
+        return TRUE;
+
+    for (i = 0; i < fstype->signature_count; i++) {
+        sig = &fstype->signatures[i];
+        if (sig->length > FSW_SIGNATURE_MAX)
+            return TRUE;
+        if (EFI_ERROR(refit_call5_wrapper(DiskIo->ReadDisk, DiskIo, MediaId, sig->offset,
+                                          sig->length, Buffer)))
+            continue;
+        if (fsw_memeq(Buffer, sig->magic, sig->length))
+            return TRUE;
+    }
+    return FALSE;
+}
+
 /**
  * Driver Binding EFI protocol, Supported function. This function is called by EFI
- * to test if this driver can handle a certain device. Our implementation only checks
- * if the device is a disk (i.e. that it supports the Block I/O and Disk I/O protocols)
- * and implicitly checks if the disk is already in use by another driver.
+ * to test if this driver can handle a certain device. Our implementation checks
+ * if the device is a disk (i.e. that it supports the Block I/O and Disk I/O protocols),
+ * implicitly checks if the disk is already in use by another driver, and rejects
+ * disks that do not carry one of the file system's superblock signatures.
  */
 
 EFI_STATUS EFIAPI fsw_efi_DriverBinding_Supported(IN EFI_DRIVER_BINDING_PROTOCOL  *This,
@@ -276,6 +311,7 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Supported(IN EFI_DRIVER_BINDING_PROTOCOL
 {
     EFI_STATUS          Status;
     EFI_DISK_IO         *DiskIo;
+    EFI_BLOCK_IO        *BlockIo;
 
     // we check for both DiskIO and BlockIO protocols
 
@@ -289,19 +325,24 @@ EFI_STATUS EFIAPI fsw_efi_DriverBinding_Supported(IN EFI_DRIVER_BINDING_PROTOCOL
     if (EFI_ERROR(Status))
         return Status;
 
+    // next, check BlockIO; we only want to look at the MediaId
+    Status = refit_call6_wrapper(BS->OpenProtocol, ControllerHandle,
+                              &gEfiBlockIoProtocolGuid,
+                              (VOID **) &BlockIo,
+                              This->DriverBindingHandle,
+                              ControllerHandle,
+                              EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+
+    // probe for the superblock signature while DiskIO is still open
+    if (!EFI_ERROR(Status) && !fsw_efi_match_signature(DiskIo, BlockIo->Media->MediaId))
+        Status = EFI_UNSUPPORTED;
+
     // we were just checking, close it again
     refit_call4_wrapper(BS->CloseProtocol, ControllerHandle,
                       &gEfiDiskIoProtocolGuid,
                       This->DriverBindingHandle,
                       ControllerHandle);
 
-    // next, check BlockIO without actually opening it
-    Status = refit_call6_wrapper(BS->OpenProtocol, ControllerHandle,
-                              &gEfiBlockIoProtocolGuid,
-                              NULL,
-                              This->DriverBindingHandle,
-                              ControllerHandle,
-                              EFI_OPEN_PROTOCOL_TEST_PROTOCOL);
     return Status;
 }
 
@@ -666,6 +707,10 @@ EFI_STATUS EFIAPI fsw_efi_FileHandle_Close(IN EFI_FILE *This)
     Print(L"fsw_efi_FileHandle_Close\n");
 #endif
 
+    if (File->DirBatch != NULL) {
+        fsw_efi_dir_release_batch(File);
+        FreePool(File->DirBatch);
+    }
     fsw_shandle_close(&File->shand);
     FreePool(File);
 
@@ -958,30 +1003,58 @@ EFI_STATUS fsw_efi_dir_read(IN FSW_FILE_DATA *File,
     EFI_STATUS          Status;
     FSW_VOLUME_DATA     *Volume = (FSW_VOLUME_DATA *)File->shand.dnode->vol->host_data;
     struct fsw_dnode    *dno;
+    fsw_u32             Count;
 
 #if DEBUG_LEVEL
     Print(L"fsw_efi_dir_read...\n");
 #endif
 
-    // read the next entry
-    Status = fsw_efi_map_status(fsw_dnode_dir_read(&File->shand, &dno), Volume);
-    if (Status == EFI_NOT_FOUND) {
-        // end of directory
-        *BufferSize = 0;
+    // read the next batch of entries when the current one is used up
+    if (File->DirBatchNext >= File->DirBatchCount) {
+        fsw_efi_dir_release_batch(File);
+        if (File->DirBatch == NULL) {
+            File->DirBatch = AllocatePool(FSW_DIR_BATCH_MAX * sizeof(struct fsw_dnode *));
+            if (File->DirBatch == NULL)
+                return EFI_OUT_OF_RESOURCES;
+        }
+        Status = fsw_efi_map_status(fsw_dnode_dir_read_batch(&File->shand, File->DirBatch,
+                                                             FSW_DIR_BATCH_MAX, &Count), Volume);
+        if (Status == EFI_NOT_FOUND) {
+            // end of directory
+            *BufferSize = 0;
 #if DEBUG_LEVEL
-        Print(L"...no more entries\n");
+            Print(L"...no more entries\n");
 #endif
-        return EFI_SUCCESS;
+            return EFI_SUCCESS;
+        }
+        if (EFI_ERROR(Status))
+            return Status;
+        File->DirBatchCount = Count;
     }
-    if (EFI_ERROR(Status))
-        return Status;
 
-    // get info into buffer
+    // get info into buffer; keep the entry if the caller has to retry with a larger buffer
+    dno = File->DirBatch[File->DirBatchNext];
     Status = fsw_efi_dnode_fill_FileInfo(Volume, dno, BufferSize, Buffer);
-    fsw_dnode_release(dno);
+    if (Status != EFI_BUFFER_TOO_SMALL) {
+        fsw_dnode_release(dno);
+        File->DirBatchNext++;
+    }
     return Status;
 }
 
+/**
+ * Release the directory entries that were read ahead but not yet returned by
+ * fsw_efi_dir_read.
+ */
+
+static VOID fsw_efi_dir_release_batch(IN FSW_FILE_DATA *File)
+{
+    while (File->DirBatchNext < File->DirBatchCount)
+        fsw_dnode_release(File->DirBatch[File->DirBatchNext++]);
+    File->DirBatchCount = 0;
+    File->DirBatchNext = 0;
+}
+
 /**
  * Set file position for directories. The only allowed set position operation
  * for directories is to rewind the directory completely by setting the
@@ -991,6 +1064,7 @@ EFI_STATUS fsw_efi_dir_read(IN FSW_FILE_DATA *File,
 EFI_STATUS fsw_efi_dir_setpos(IN FSW_FILE_DATA *File, IN UINT64 Position)
 {
     if (Position == 0) {
+        fsw_efi_dir_release_batch(File);
         File->shand.pos = 0;
         return EFI_SUCCESS;
     } else {
@@ -1137,8 +1211,6 @@ EFI_STATUS fsw_efi_dnode_fill_FileInfo(IN FSW_VOLUME_DATA *Volume,
     // check buffer size
     RequiredSize = SIZE_OF_EFI_FILE_INFO + fsw_efi_strsize(&dno->name);
     if (*BufferSize < RequiredSize) {
-        // TODO: wind back the directory in this case
-
 #if DEBUG_LEVEL
         Print(L"...BUFFER TOO SMALL\n");
 #endif
@@ -1151,9 +1223,11 @@ EFI_STATUS fsw_efi_dnode_fill_FileInfo(IN FSW_VOLUME_DATA *Volume,
     FileInfo = (EFI_FILE_INFO *)Buffer;
     FileInfo->Size = RequiredSize;
     FileInfo->FileSize          = dno->size;
-    FileInfo->Attribute         = 0;
+    FileInfo->Attribute         = EFI_FILE_FSW_TYPE_VALID;
     if (dno->type == FSW_DNODE_TYPE_DIR)
         FileInfo->Attribute    |= EFI_FILE_DIRECTORY;
+    else if (dno->type == FSW_DNODE_TYPE_SYMLINK)
+        FileInfo->Attribute    |= EFI_FILE_FSW_SYMLINK;
     fsw_efi_strcpy(FileInfo->FileName, &dno->name);
 
     // get the missing info from the fs driver
@@ -79,6 +79,10 @@ typedef struct {
     UINT64                       Type;           //!< File type used for dispatching
     struct fsw_shandle          shand;          //!< FSW handle for this file
 
+    struct fsw_dnode            **DirBatch;     //!< Directory entries read ahead, for directories
+    UINTN                       DirBatchCount;  //!< Number of entries in DirBatch
+    UINTN                       DirBatchNext;   //!< Index of the next DirBatch entry to return
+
 } FSW_FILE_DATA;
 
 /** File type: regular file. */
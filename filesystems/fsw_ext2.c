@@ -50,6 +50,11 @@ static fsw_status_t fsw_ext2_readlink(struct fsw_ext2_volume *vol, struct fsw_ex
 // Dispatch Table
 //
 
+// the little-endian s_magic field of the superblock
+static const struct fsw_signature fsw_ext2_signatures[] = {
+    { EXT2_SUPERBLOCK_BLOCKNO * EXT2_SUPERBLOCK_BLOCKSIZE + 56, 2, "\x53\xEF" },
+};
+
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ext2) = {
     { FSW_STRING_TYPE_ISO88591, 4, 4, "ext2" },
     sizeof(struct fsw_ext2_volume),
@@ -65,6 +70,8 @@ struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ext2) = {
     fsw_ext2_dir_lookup,
     fsw_ext2_dir_read,
     fsw_ext2_readlink,
+    fsw_ext2_signatures,
+    sizeof(fsw_ext2_signatures) / sizeof(fsw_ext2_signatures[0]),
 };
 
 /**
@@ -55,6 +55,11 @@ static fsw_status_t fsw_ext4_readlink(struct fsw_ext4_volume *vol, struct fsw_ex
 // Dispatch Table
 //
 
+// the little-endian s_magic field of the superblock
+static const struct fsw_signature fsw_ext4_signatures[] = {
+    { EXT4_SUPERBLOCK_BLOCKNO * EXT4_SUPERBLOCK_BLOCKSIZE + 56, 2, "\x53\xEF" },
+};
+
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ext4) = {
     { FSW_STRING_TYPE_ISO88591, 4, 4, "ext4" },
     sizeof(struct fsw_ext4_volume),
@@ -70,6 +75,8 @@ struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(ext4) = {
     fsw_ext4_dir_lookup,
     fsw_ext4_dir_read,
     fsw_ext4_readlink,
+    fsw_ext4_signatures,
+    sizeof(fsw_ext4_signatures) / sizeof(fsw_ext4_signatures[0]),
 };
 
 
@@ -76,6 +76,13 @@ static fsw_status_t fsw_hfs_readlink(struct fsw_hfs_volume *vol, struct fsw_hfs_
 // Dispatch Table
 //
 
+// big-endian signature word of the volume header: H+, HX or BD (plain HFS wrapper)
+static const struct fsw_signature fsw_hfs_signatures[] = {
+    { HFS_SUPERBLOCK_BLOCKNO * HFS_BLOCKSIZE, 2, "H+" },
+    { HFS_SUPERBLOCK_BLOCKNO * HFS_BLOCKSIZE, 2, "HX" },
+    { HFS_SUPERBLOCK_BLOCKNO * HFS_BLOCKSIZE, 2, "BD" },
+};
+
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(hfs) = {
     { FSW_STRING_TYPE_ISO88591, 4, 4, "hfs" },
     sizeof(struct fsw_hfs_volume),
@@ -91,6 +98,8 @@ struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(hfs) = {
     fsw_hfs_dir_lookup,  //retrieve the directory entry with the given name
     fsw_hfs_dir_read,	// next directory entry when reading a directory
     fsw_hfs_readlink,   // return FSW_UNSUPPORTED;
+    fsw_hfs_signatures,
+    sizeof(fsw_hfs_signatures) / sizeof(fsw_hfs_signatures[0]),
 };
 
 static const fsw_u16 fsw_latin_case_fold[] =
@@ -108,6 +108,11 @@ static fsw_status_t rr_read_ce(struct fsw_iso9660_volume *vol, union fsw_rock_ri
 // Dispatch Table
 //
 
+// standard identifier of the first volume descriptor
+static const struct fsw_signature fsw_iso9660_signatures[] = {
+    { ISO9660_SUPERBLOCK_BLOCKNO * ISO9660_BLOCKSIZE + 1, 5, "CD001" },
+};
+
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(iso9660) = {
     { FSW_STRING_TYPE_ISO88591, 4, 4, "iso9660" },
     sizeof(struct fsw_iso9660_volume),
@@ -123,6 +128,8 @@ struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(iso9660) = {
     fsw_iso9660_dir_lookup,
     fsw_iso9660_dir_read,
     fsw_iso9660_readlink,
+    fsw_iso9660_signatures,
+    sizeof(fsw_iso9660_signatures) / sizeof(fsw_iso9660_signatures[0]),
 };
 
 static fsw_status_t rr_find_sp(struct iso9660_dirrec *dirrec, struct fsw_rock_ridge_susp_sp **psp)
@@ -57,6 +57,12 @@ static void fsw_reiserfs_item_release(struct fsw_reiserfs_volume *vol,
 // Dispatch Table
 //
 
+// common prefix of the s_magic strings, at both superblock locations
+static const struct fsw_signature fsw_reiserfs_signatures[] = {
+    { REISERFS_DISK_OFFSET_IN_BYTES + 52, 6, "ReIsEr" },
+    { REISERFS_OLD_DISK_OFFSET_IN_BYTES + 52, 6, "ReIsEr" },
+};
+
 struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(reiserfs) = {
     { FSW_STRING_TYPE_ISO88591, 8, 8, "reiserfs" },
     sizeof(struct fsw_reiserfs_volume),
@@ -72,6 +78,8 @@ struct fsw_fstype_table   FSW_FSTYPE_TABLE_NAME(reiserfs) = {
     fsw_reiserfs_dir_lookup,
     fsw_reiserfs_dir_read,
     fsw_reiserfs_readlink,
+    fsw_reiserfs_signatures,
+    sizeof(fsw_reiserfs_signatures) / sizeof(fsw_reiserfs_signatures[0]),
 };
 
 // misc data
@@ -35,25 +35,7 @@
  */
 
 #include "gptsync.h"
-
-//
-// memory string search
-//
-
-static INTN FindMem(VOID *Buffer, UINTN BufferLength, VOID *SearchString, UINTN SearchStringLength)
-{
-    UINT8 *BufferPtr;
-    UINTN Offset;
-    
-    BufferPtr = Buffer;
-    BufferLength -= SearchStringLength;
-    for (Offset = 0; Offset < BufferLength; Offset++, BufferPtr++) {
-        if (CompareMem(BufferPtr, SearchString, SearchStringLength) == 0)
-            return (INTN)Offset;
-    }
-    
-    return -1;
-}
+#include "../include/bootcode.h"
 
 //
 // detect boot code
@@ -63,6 +45,7 @@ static UINTN detect_bootcode(UINT64 partlba, CHARN **bootcodename)
 {
     UINTN   status;
     BOOLEAN bootable;
+    UINT32  sigs;
     
     // read MBR data
     status = read_sector(partlba, sector);
@@ -75,6 +58,7 @@ static UINTN detect_bootcode(UINT64 partlba, CHARN **bootcodename)
     else
         bootable = FALSE;
     *bootcodename = NULL;
+    sigs = FindBootcodeSignatures(sector, 512);
     
     // detect specific boot codes
     if (CompareMem(sector + 2, "LILO", 4) == 0 ||
@@ -84,51 +68,48 @@ static UINTN detect_bootcode(UINT64 partlba, CHARN **bootcodename)
     } else if (CompareMem(sector + 3, "SYSLINUX", 8) == 0) {
         *bootcodename = STR("SYSLINUX");
         
-    } else if (FindMem(sector, 512, "ISOLINUX", 8) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_ISOLINUX) {
         *bootcodename = STR("ISOLINUX");
         
-    } else if (FindMem(sector, 512, "Geom\0Hard Disk\0Read\0 Error", 26) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_GRUB) {
         *bootcodename = STR("GRUB");
         
     } else if ((*((UINT32 *)(sector + 502)) == 0 &&
                 *((UINT32 *)(sector + 506)) == 50000 &&
                 *((UINT16 *)(sector + 510)) == 0xaa55) ||
-               FindMem(sector, 512, "Starting the BTX loader", 23) >= 0) {
+               (sigs & BOOTCODE_SIG_BTX)) {
         *bootcodename = STR("FreeBSD");
         
-    } else if (FindMem(sector, 512, "!Loading", 8) >= 0 ||
-               FindMem(sector, 512, "/cdboot\0/CDBOOT\0", 16) >= 0) {
+    } else if (sigs & (BOOTCODE_SIG_OPENBSD_LOADING | BOOTCODE_SIG_OPENBSD_CDBOOT)) {
         *bootcodename = STR("OpenBSD");
         
-    } else if (FindMem(sector, 512, "Not a bootxx image", 18) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_NETBSD) {
         *bootcodename = STR("NetBSD");
         
-    } else if (FindMem(sector, 512, "NTLDR", 5) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_NTLDR) {
         *bootcodename = STR("Windows NTLDR");
         
-    } else if (FindMem(sector, 512, "BOOTMGR", 7) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_BOOTMGR) {
         *bootcodename = STR("Windows BOOTMGR (Vista)");
         
-    } else if (FindMem(sector, 512, "CPUBOOT SYS", 11) >= 0 ||
-               FindMem(sector, 512, "KERNEL  SYS", 11) >= 0) {
+    } else if (sigs & (BOOTCODE_SIG_FREEDOS_CPUBOOT | BOOTCODE_SIG_FREEDOS_KERNEL)) {
         *bootcodename = STR("FreeDOS");
         
-    } else if (FindMem(sector, 512, "OS2LDR", 6) >= 0 ||
-               FindMem(sector, 512, "OS2BOOT", 7) >= 0) {
+    } else if (sigs & (BOOTCODE_SIG_OS2LDR | BOOTCODE_SIG_OS2BOOT)) {
         *bootcodename = STR("eComStation");
         
-    } else if (FindMem(sector, 512, "Be Boot Loader", 14) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_BEOS) {
         *bootcodename = STR("BeOS");
         
-    } else if (FindMem(sector, 512, "yT Boot Loader", 14) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_ZETA) {
         *bootcodename = STR("ZETA");
         
-    } else if (FindMem(sector, 512, "\x04" "beos\x06" "system\x05" "zbeos", 18) >= 0) {
+    } else if (sigs & BOOTCODE_SIG_HAIKU_ZBEOS) {
         *bootcodename = STR("Haiku");
         
     }
     
-    if (FindMem(sector, 512, "Non-system disk", 15) >= 0)   // dummy FAT boot sector
+    if (sigs & BOOTCODE_SIG_NONSYSTEM_OSX)   // dummy FAT boot sector
         *bootcodename = STR("None (Non-system disk message)");
     
     // TODO: Add a note if a specific code was detected, but the sector is not bootable?
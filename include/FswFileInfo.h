@@ -0,0 +1,42 @@
+/*
+ * include/FswFileInfo.h
+ * Extension to EFI_FILE_INFO used by rEFInd's filesystem drivers
+ *
+ * Distributed under the terms of the GNU General Public License (GPL)
+ * version 3 (GPLv3), a copy of which must be distributed with this source
+ * code or binaries made from it.
+ *
+ * EFI has no notion of symbolic links, so the fsw drivers follow them when a
+ * file is opened and a directory listing can't tell a link from its target.
+ * The drivers therefore mark the EFI_FILE_INFO records they return with the
+ * bits below.
+ *
+ * These are NOT a registered or GUID-identified extension. They are two bits
+ * of EFI_FILE_INFO.Attribute that the UEFI specification reserves (everything
+ * outside EFI_FILE_VALID_ATTR), picked by hand for use between rEFInd and its
+ * own drivers. Consequently:
+ *
+ *  - They mean something only when EFI_FILE_FSW_TYPE_VALID is set. A foreign
+ *    driver that happened to set the same bits would be misread, so callers
+ *    should treat EFI_FILE_FSW_SYMLINK as a hint, not a guarantee.
+ *  - A spec-compliant SetInfo() rejects reserved attribute bits, so code that
+ *    passes a FileInfo it got from GetInfo() or Read() back to SetInfo() must
+ *    clear them first. (The fsw drivers are read-only, so this matters only
+ *    if a record is handed to another driver.)
+ *  - Firmware and tools that don't know about them ignore them.
+ */
+
+#ifndef __FSW_FILE_INFO_H_
+#define __FSW_FILE_INFO_H_
+
+// Set on every EFI_FILE_INFO returned by an fsw driver, to say that the
+// EFI_FILE_FSW_SYMLINK bit is meaningful
+#define EFI_FILE_FSW_TYPE_VALID  0x0000000100000000ULL
+
+// Set if the directory entry is a symbolic link
+#define EFI_FILE_FSW_SYMLINK     0x0000000200000000ULL
+
+// All the attribute bits defined here; clear these before calling SetInfo()
+#define EFI_FILE_FSW_ATTR_MASK   (EFI_FILE_FSW_TYPE_VALID | EFI_FILE_FSW_SYMLINK)
+
+#endif
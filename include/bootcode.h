@@ -0,0 +1,120 @@
+/*
+ * include/bootcode.h
+ * Boot sector signatures, shared by rEFInd's ScanVolumeBootcode() and by
+ * gptsync/showpart's detect_bootcode()
+ *
+ * The signatures were taken from rEFIt, copyright (c) 2006 Christoph
+ * Pfisterer, and this file is distributed under the same BSD license as
+ * gptsync/showpart.c, which holds the full license text.
+ *
+ * The matcher below classifies a sector in a single pass: the patterns are
+ * bucketed by their first byte, so each position of the buffer costs one
+ * table lookup, and a full comparison is done only for the (rare) patterns
+ * whose first byte matches. This replaces a dozen or more sequential
+ * FindMem() scans over the same buffer.
+ */
+
+#ifndef __BOOTCODE_H_
+#define __BOOTCODE_H_
+
+// Bit flags returned by FindBootcodeSignatures()
+#define BOOTCODE_SIG_EXFAT              (1 << 0)
+#define BOOTCODE_SIG_ISOLINUX           (1 << 1)
+#define BOOTCODE_SIG_GRUB               (1 << 2)
+#define BOOTCODE_SIG_BTX                (1 << 3)
+#define BOOTCODE_SIG_OPENBSD_LOADING    (1 << 4)
+#define BOOTCODE_SIG_OPENBSD_CDBOOT     (1 << 5)
+#define BOOTCODE_SIG_NETBSD             (1 << 6)
+#define BOOTCODE_SIG_NTLDR              (1 << 7)
+#define BOOTCODE_SIG_BOOTMGR            (1 << 8)
+#define BOOTCODE_SIG_FREEDOS_CPUBOOT    (1 << 9)
+#define BOOTCODE_SIG_FREEDOS_KERNEL     (1 << 10)
+#define BOOTCODE_SIG_OS2LDR             (1 << 11)
+#define BOOTCODE_SIG_OS2BOOT            (1 << 12)
+#define BOOTCODE_SIG_BEOS               (1 << 13)
+#define BOOTCODE_SIG_ZETA               (1 << 14)
+#define BOOTCODE_SIG_HAIKU_ZBEOS        (1 << 15)
+#define BOOTCODE_SIG_HAIKU_LOADER       (1 << 16)
+#define BOOTCODE_SIG_NONSYSTEM_OSX      (1 << 17)
+#define BOOTCODE_SIG_NONSYSTEM_LINUX    (1 << 18)
+#define BOOTCODE_SIG_NONSYSTEM_WINDOWS  (1 << 19)
+
+typedef struct {
+    UINT32      Flag;      // BOOTCODE_SIG_* value set when the pattern is found
+    UINTN       Limit;     // pattern must lie entirely within this many bytes
+    UINTN       Length;
+    const char  *Pattern;
+} BOOTCODE_SIGNATURE;
+
+static const BOOTCODE_SIGNATURE BootcodeSignatures[] = {
+    { BOOTCODE_SIG_EXFAT,             512,  5,  "EXFAT" },
+    { BOOTCODE_SIG_ISOLINUX,          4096, 8,  "ISOLINUX" },
+    { BOOTCODE_SIG_GRUB,              512,  26, "Geom\0Hard Disk\0Read\0 Error" },
+    { BOOTCODE_SIG_BTX,               4096, 23, "Starting the BTX loader" },
+    { BOOTCODE_SIG_OPENBSD_LOADING,   512,  8,  "!Loading" },
+    { BOOTCODE_SIG_OPENBSD_CDBOOT,    4096, 16, "/cdboot\0/CDBOOT\0" },
+    { BOOTCODE_SIG_NETBSD,            512,  18, "Not a bootxx image" },
+    { BOOTCODE_SIG_NTLDR,             4096, 5,  "NTLDR" },
+    { BOOTCODE_SIG_BOOTMGR,           4096, 7,  "BOOTMGR" },
+    { BOOTCODE_SIG_FREEDOS_CPUBOOT,   512,  11, "CPUBOOT SYS" },
+    { BOOTCODE_SIG_FREEDOS_KERNEL,    512,  11, "KERNEL  SYS" },
+    { BOOTCODE_SIG_OS2LDR,            512,  6,  "OS2LDR" },
+    { BOOTCODE_SIG_OS2BOOT,           512,  7,  "OS2BOOT" },
+    { BOOTCODE_SIG_BEOS,              512,  14, "Be Boot Loader" },
+    { BOOTCODE_SIG_ZETA,              512,  14, "yT Boot Loader" },
+    { BOOTCODE_SIG_HAIKU_ZBEOS,       512,  18, "\x04" "beos\x06" "system\x05" "zbeos" },
+    { BOOTCODE_SIG_HAIKU_LOADER,      512,  20, "\x06" "system\x0c" "haiku_loader" },
+    { BOOTCODE_SIG_NONSYSTEM_OSX,     512,  15, "Non-system disk" },
+    { BOOTCODE_SIG_NONSYSTEM_LINUX,   512,  27, "This is not a bootable disk" },
+    { BOOTCODE_SIG_NONSYSTEM_WINDOWS, 512,  24, "Press any key to restart" }
+};
+
+#define BOOTCODE_SIGNATURE_COUNT (sizeof(BootcodeSignatures) / sizeof(BootcodeSignatures[0]))
+
+// BootcodeFirst[c] is one more than the index of the first signature beginning
+// with byte c (0 if none); BootcodeNext[] chains signatures sharing that byte.
+static UINT8 BootcodeFirst[256];
+static UINT8 BootcodeNext[BOOTCODE_SIGNATURE_COUNT];
+static UINTN BootcodeMaxLimit = 0;
+static BOOLEAN BootcodeTablesReady = FALSE;
+
+static VOID BuildBootcodeTables(VOID) {
+    UINTN i;
+    UINT8 c;
+
+    for (i = BOOTCODE_SIGNATURE_COUNT; i > 0; i--) {
+        c = (UINT8) BootcodeSignatures[i - 1].Pattern[0];
+        BootcodeNext[i - 1] = BootcodeFirst[c];
+        BootcodeFirst[c] = (UINT8) i;
+        if (BootcodeSignatures[i - 1].Limit > BootcodeMaxLimit)
+            BootcodeMaxLimit = BootcodeSignatures[i - 1].Limit;
+    }
+    BootcodeTablesReady = TRUE;
+} // VOID BuildBootcodeTables()
+
+// Scan the first Length bytes of Buffer once and return the BOOTCODE_SIG_*
+// flags of every signature found within its limit.
+static UINT32 FindBootcodeSignatures(UINT8 *Buffer, UINTN Length) {
+    UINT32  Found = 0;
+    UINTN   Offset, i;
+    const BOOTCODE_SIGNATURE *Sig;
+
+    if (!BootcodeTablesReady)
+        BuildBootcodeTables();
+
+    if (Length > BootcodeMaxLimit)
+        Length = BootcodeMaxLimit;
+
+    for (Offset = 0; Offset < Length; Offset++) {
+        for (i = BootcodeFirst[Buffer[Offset]]; i != 0; i = BootcodeNext[i - 1]) {
+            Sig = &BootcodeSignatures[i - 1];
+            if ((Found & Sig->Flag) || (Offset + Sig->Length > Sig->Limit) || (Offset + Sig->Length > Length))
+                continue;
+            if (CompareMem(Buffer + Offset, (VOID *) Sig->Pattern, Sig->Length) == 0)
+                Found |= Sig->Flag;
+        }
+    }
+    return Found;
+} // UINT32 FindBootcodeSignatures()
+
+#endif
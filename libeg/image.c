@@ -289,6 +289,28 @@ EFI_STATUS egSaveFile(IN EFI_FILE* BaseDir OPTIONAL, IN CHAR16 *FileName,
 // Loading images from files and embedded data
 //
 
+// Image file formats, as identified by egImageFormat()
+#define EG_FORMAT_UNKNOWN (0)
+#define EG_FORMAT_ICNS    (1)
+#define EG_FORMAT_PNG     (2)
+#define EG_FORMAT_BMP     (3)
+
+// Identify the format of the specified image data by its magic bytes, so
+// that it can be handed to the one decoder that can handle it.
+static UINTN egImageFormat(IN UINT8 *FileData, IN UINTN FileDataLength)
+{
+   if (FileData == NULL)
+      return EG_FORMAT_UNKNOWN;
+   if (FileDataLength >= 4 && FileData[0] == 'i' && FileData[1] == 'c' && FileData[2] == 'n' && FileData[3] == 's')
+      return EG_FORMAT_ICNS;
+   if (FileDataLength >= 8 && FileData[0] == 0x89 && FileData[1] == 'P' && FileData[2] == 'N' && FileData[3] == 'G' &&
+       FileData[4] == 0x0d && FileData[5] == 0x0a && FileData[6] == 0x1a && FileData[7] == 0x0a)
+      return EG_FORMAT_PNG;
+   if (FileDataLength >= 2 && FileData[0] == 'B' && FileData[1] == 'M')
+      return EG_FORMAT_BMP;
+   return EG_FORMAT_UNKNOWN;
+} // static UINTN egImageFormat()
+
 // Decode the specified image data. The IconSize parameter is relevant only
 // for ICNS, for which it selects which ICNS sub-image is decoded.
 // Returns a pointer to the resulting EG_IMAGE or NULL if decoding failed.
@@ -296,11 +318,17 @@ static EG_IMAGE * egDecodeAny(IN UINT8 *FileData, IN UINTN FileDataLength, IN UI
 {
    EG_IMAGE        *NewImage = NULL;
 
-   NewImage = egDecodeICNS(FileData, FileDataLength, IconSize, WantAlpha);
-   if (NewImage == NULL)
-      NewImage = egDecodePNG(FileData, FileDataLength, IconSize, WantAlpha);
-   if (NewImage == NULL)
-      NewImage = egDecodeBMP(FileData, FileDataLength, IconSize, WantAlpha);
+   switch (egImageFormat(FileData, FileDataLength)) {
+      case EG_FORMAT_ICNS:
+         NewImage = egDecodeICNS(FileData, FileDataLength, IconSize, WantAlpha);
+         break;
+      case EG_FORMAT_PNG:
+         NewImage = egDecodePNG(FileData, FileDataLength, IconSize, WantAlpha);
+         break;
+      case EG_FORMAT_BMP:
+         NewImage = egDecodeBMP(FileData, FileDataLength, IconSize, WantAlpha);
+         break;
+   } // switch
 
    return NewImage;
 }
@@ -344,9 +372,15 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *Path, IN UINTN IconSize)
     if (EFI_ERROR(Status))
        return NULL;
 
-    // decode it
-    Image = egDecodeAny(FileData, FileDataLength, IconSize, TRUE);
+    // decode it; large PNGs are scaled down while they're decoded, and ICNS
+    // files yield the sub-image closest to IconSize
+    if (egImageFormat(FileData, FileDataLength) == EG_FORMAT_PNG)
+       Image = egDecodeScaledPNG(FileData, FileDataLength, IconSize, TRUE);
+    else
+       Image = egDecodeAny(FileData, FileDataLength, IconSize, TRUE);
     FreePool(FileData);
+    if (Image == NULL)
+       return NULL;
     if ((Image->Width != IconSize) || (Image->Height != IconSize)) {
        NewImage = egScaleImage(Image, IconSize, IconSize);
        if (!NewImage)
@@ -400,7 +434,8 @@ EG_IMAGE * egFindIcon(IN CHAR16 *BaseName, IN UINTN IconSize) {
    return Image;
 } // EG_IMAGE * egFindIcon()
 
-EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha)
+// Decompress and interleave the planes of an embedded image into a new EG_IMAGE.
+static EG_IMAGE * egExpandEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha)
 {
     EG_IMAGE            *NewImage;
     UINT8               *CompData;
@@ -481,6 +516,36 @@ EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEA
     return NewImage;
 }
 
+// Returns the expanded form of an embedded image. Each image is expanded at
+// most once (per alpha setting); later calls return the same EG_IMAGE, so
+// the caller must neither modify nor free it.
+EG_IMAGE * egGetEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha)
+{
+    UINTN Index = WantAlpha ? 1 : 0;
+
+    if (EmbeddedImage == NULL)
+        return NULL;
+    if (EmbeddedImage->Expanded[Index] == NULL)
+        EmbeddedImage->Expanded[Index] = egExpandEmbeddedImage(EmbeddedImage, WantAlpha);
+    return EmbeddedImage->Expanded[Index];
+} // EG_IMAGE * egGetEmbeddedImage()
+
+// Returns an embedded image that the caller owns and may modify or free.
+// This doesn't fill the cache used by egGetEmbeddedImage(), since its callers
+// (the font, the banner, the selection backgrounds) keep their own image and
+// a cached copy would only double the memory they use. If the image has
+// already been cached, though, copying it is cheaper than decoding it again.
+EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha)
+{
+    UINTN Index = WantAlpha ? 1 : 0;
+
+    if (EmbeddedImage == NULL)
+        return NULL;
+    if (EmbeddedImage->Expanded[Index] != NULL)
+        return egCopyImage(EmbeddedImage->Expanded[Index]);
+    return egExpandEmbeddedImage(EmbeddedImage, WantAlpha);
+} // EG_IMAGE * egPrepareEmbeddedImage()
+
 //
 // Compositing
 //
@@ -80,6 +80,7 @@ typedef struct {
     UINTN       CompressMode;
     const UINT8 *Data;
     UINTN       DataLength;
+    EG_IMAGE    *Expanded[2];   // cached expansions without [0] and with [1] alpha; see egGetEmbeddedImage()
 } EG_EMBEDDED_IMAGE;
 
 /* functions */
@@ -108,6 +109,7 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE* BaseDir, IN CHAR16 *FileName, IN UINTN IconSi
 EG_IMAGE * egLoadIconAnyType(IN EFI_FILE *BaseDir, IN CHAR16 *SubdirName, IN CHAR16 *BaseName, IN UINTN IconSize);
 EG_IMAGE * egFindIcon(IN CHAR16 *BaseName, IN UINTN IconSize);
 EG_IMAGE * egPrepareEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha);
+EG_IMAGE * egGetEmbeddedImage(IN EG_EMBEDDED_IMAGE *EmbeddedImage, IN BOOLEAN WantAlpha);
 
 EG_IMAGE * egEnsureImageSize(IN EG_IMAGE *Image, IN UINTN Width, IN UINTN Height, IN EG_PIXEL *Color);
 
@@ -94,6 +94,31 @@ VOID egDecompressIcnsRLE(IN OUT UINT8 **CompData, IN OUT UINTN *CompLen, IN UINT
 // Load Apple .icns icons
 //
 
+// Tagged blocks that hold the RGB data and the alpha mask of each icon size
+// supported here, largest first. The 128x128 RGB data starts after four
+// extra zero bytes.
+static struct {
+    UINTN       Size;
+    CHAR8       DataTag[5];
+    CHAR8       MaskTag[5];
+    UINTN       DataOffset;
+} IcnsSizes[MAX_ICNS_SIZES] = {
+    { 128, "it32", "t8mk", 12 },
+    {  48, "ih32", "h8mk", 8 },
+    {  32, "il32", "l8mk", 8 },
+    {  16, "is32", "s8mk", 8 }
+};
+
+static BOOLEAN IcnsTagIs(IN UINT8 *Ptr, IN CHAR8 *Tag)
+{
+    return (Ptr[0] == Tag[0] && Ptr[1] == Tag[1] && Ptr[2] == Tag[2] && Ptr[3] == Tag[3]);
+}
+
+// Decode the sub-image of an .icns file that best matches IconSize: an exact
+// match if there is one, otherwise the smallest larger image (so that the
+// caller only ever has to scale down), otherwise the largest image present.
+// The file's blocks are indexed in a single pass, and only the selected
+// image is decoded.
 EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha)
 {
     EG_IMAGE            *NewImage;
@@ -104,8 +129,9 @@ EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ic
     UINTN               CompLen;
     UINT8               *SrcPtr;
     EG_PIXEL            *DestPtr;
-    UINTN               SizesToTry[MAX_ICNS_SIZES + 1] = {IconSize, 128, 48, 32, 16};
-    UINTN               SizeToTry = 0;
+    UINT8               *DataPtrs[MAX_ICNS_SIZES], *MaskPtrs[MAX_ICNS_SIZES];
+    UINT32              DataLens[MAX_ICNS_SIZES], MaskLens[MAX_ICNS_SIZES];
+    INTN                Best = -1;
 
     if (FileDataLength < 8 || FileData == NULL ||
         FileData[0] != 'i' || FileData[1] != 'c' || FileData[2] != 'n' || FileData[3] != 's') {
@@ -113,73 +139,48 @@ EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ic
         return NULL;
     }
 
-    for (;;) {
-        DataPtr = NULL;
-        DataLen = 0;
-        MaskPtr = NULL;
-        MaskLen = 0;
-
-        do {
-           IconSize = SizesToTry[SizeToTry];
-           Ptr = FileData + 8;
-           BufferEnd = FileData + FileDataLength;
-           // iterate over tagged blocks in the file
-           while (Ptr + 8 <= BufferEnd) {
-               BlockLen = ((UINT32)Ptr[4] << 24) + ((UINT32)Ptr[5] << 16) + ((UINT32)Ptr[6] << 8) + (UINT32)Ptr[7];
-               if (Ptr + BlockLen > BufferEnd)   // block continues beyond end of file
-                   break;
-
-               // extract the appropriate blocks for each pixel size
-               if (IconSize == 128) {
-                   if (Ptr[0] == 'i' && Ptr[1] == 't' && Ptr[2] == '3' && Ptr[3] == '2') {
-                       if (Ptr[8] == 0 && Ptr[9] == 0 && Ptr[10] == 0 && Ptr[11] == 0) {
-                           DataPtr = Ptr + 12;
-                           DataLen = BlockLen - 12;
-                       }
-                   } else if (Ptr[0] == 't' && Ptr[1] == '8' && Ptr[2] == 'm' && Ptr[3] == 'k') {
-                       MaskPtr = Ptr + 8;
-                       MaskLen = BlockLen - 8;
-                   }
-
-               } else if (IconSize == 48) {
-                   if (Ptr[0] == 'i' && Ptr[1] == 'h' && Ptr[2] == '3' && Ptr[3] == '2') {
-                       DataPtr = Ptr + 8;
-                       DataLen = BlockLen - 8;
-                   } else if (Ptr[0] == 'h' && Ptr[1] == '8' && Ptr[2] == 'm' && Ptr[3] == 'k') {
-                       MaskPtr = Ptr + 8;
-                       MaskLen = BlockLen - 8;
-                   }
-
-               } else if (IconSize == 32) {
-                   if (Ptr[0] == 'i' && Ptr[1] == 'l' && Ptr[2] == '3' && Ptr[3] == '2') {
-                       DataPtr = Ptr + 8;
-                       DataLen = BlockLen - 8;
-                   } else if (Ptr[0] == 'l' && Ptr[1] == '8' && Ptr[2] == 'm' && Ptr[3] == 'k') {
-                       MaskPtr = Ptr + 8;
-                       MaskLen = BlockLen - 8;
-                   }
-
-               } else if (IconSize == 16) {
-                   if (Ptr[0] == 'i' && Ptr[1] == 's' && Ptr[2] == '3' && Ptr[3] == '2') {
-                       DataPtr = Ptr + 8;
-                       DataLen = BlockLen - 8;
-                   } else if (Ptr[0] == 's' && Ptr[1] == '8' && Ptr[2] == 'm' && Ptr[3] == 'k') {
-                       MaskPtr = Ptr + 8;
-                       MaskLen = BlockLen - 8;
-                   }
-
-               }
-
-               Ptr += BlockLen;
-           }
-        } while ((DataPtr == NULL) && (SizeToTry++ < MAX_ICNS_SIZES));
-
-        break;
+    for (i = 0; i < MAX_ICNS_SIZES; i++) {
+        DataPtrs[i] = MaskPtrs[i] = NULL;
+        DataLens[i] = MaskLens[i] = 0;
     }
 
-    if (DataPtr == NULL)
+    // iterate over tagged blocks in the file, noting the blocks for each pixel size
+    Ptr = FileData + 8;
+    BufferEnd = FileData + FileDataLength;
+    while (Ptr + 8 <= BufferEnd) {
+        BlockLen = ((UINT32)Ptr[4] << 24) + ((UINT32)Ptr[5] << 16) + ((UINT32)Ptr[6] << 8) + (UINT32)Ptr[7];
+        if (BlockLen < 8 || Ptr + BlockLen > BufferEnd)   // bogus block or block continues beyond end of file
+            break;
+
+        for (i = 0; i < MAX_ICNS_SIZES; i++) {
+            if (IcnsTagIs(Ptr, IcnsSizes[i].DataTag) && BlockLen >= IcnsSizes[i].DataOffset) {
+                if (IcnsSizes[i].DataOffset == 8 || (Ptr[8] == 0 && Ptr[9] == 0 && Ptr[10] == 0 && Ptr[11] == 0)) {
+                    DataPtrs[i] = Ptr + IcnsSizes[i].DataOffset;
+                    DataLens[i] = BlockLen - (UINT32) IcnsSizes[i].DataOffset;
+                }
+            } else if (IcnsTagIs(Ptr, IcnsSizes[i].MaskTag)) {
+                MaskPtrs[i] = Ptr + 8;
+                MaskLens[i] = BlockLen - 8;
+            }
+        }
+
+        Ptr += BlockLen;
+    }
+
+    // pick the best size; IcnsSizes is ordered largest first
+    for (i = 0; i < MAX_ICNS_SIZES; i++) {
+        if (DataPtrs[i] != NULL && (Best < 0 || IcnsSizes[i].Size >= IconSize))
+            Best = (INTN) i;
+    }
+    if (Best < 0)
         return NULL;   // no image found
 
+    IconSize = IcnsSizes[Best].Size;
+    DataPtr = DataPtrs[Best];
+    DataLen = DataLens[Best];
+    MaskPtr = MaskPtrs[Best];
+    MaskLen = MaskLens[Best];
+
     // allocate image structure and buffer
     NewImage = egCreateImage(IconSize, IconSize, WantAlpha);
     if (NewImage == NULL)
@@ -218,8 +219,6 @@ EG_IMAGE * egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN Ic
     else
         egSetPlane(PLPTR(NewImage, a), WantAlpha ? 255 : 0, PixelCount);
 
-    // FUTURE: scale to originally requested size if we had to load another size
-
     return NewImage;
 } // EG_IMAGE * egDecodeICNS()
 
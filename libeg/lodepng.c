@@ -952,6 +952,48 @@ static unsigned huffmanDecodeSymbol(const unsigned char* in, size_t* bp,
 /* / Inflator (Decompressor)                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
+/*
+rEFInd addition: optional output sink for the inflator. Without one, the out vector
+receives the whole decompressed stream. With one, out only holds a sliding window:
+once enough output has accumulated, the bytes not yet seen by the sink are passed to
+its flush function and everything but the last INFLATE_WINDOW_SIZE bytes (the largest
+backward distance deflate can use) is discarded. This keeps the memory needed to
+decompress a large image down to a few dozen kilobytes.
+*/
+#define INFLATE_WINDOW_SIZE 32768
+#define INFLATE_FLUSH_SIZE 65536
+
+typedef struct InflateSink
+{
+  unsigned (*flush)(void* context, const unsigned char* data, size_t size);
+  void* context;
+  size_t flushed; /*position in the window up to which data was passed to flush*/
+  unsigned adler; /*running adler32 checksum of all flushed data*/
+} InflateSink;
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len);
+
+/*pass all output that the sink hasn't seen yet to its flush function*/
+static unsigned inflateFlush(InflateSink* sink, const ucvector* out, size_t pos)
+{
+  size_t start = sink->flushed;
+  sink->adler = update_adler32(sink->adler, &out->data[start], (unsigned)(pos - start));
+  sink->flushed = pos;
+  return sink->flush(sink->context, &out->data[start], pos - start);
+}
+
+/*flush the output, then move the last INFLATE_WINDOW_SIZE bytes to the start of the window*/
+static unsigned inflateSlideWindow(InflateSink* sink, ucvector* out, size_t* pos)
+{
+  size_t keep, start, i;
+  CERROR_TRY_RETURN(inflateFlush(sink, out, *pos));
+  keep = (*pos) < INFLATE_WINDOW_SIZE ? (*pos) : INFLATE_WINDOW_SIZE;
+  start = (*pos) - keep;
+  for(i = 0; i < keep; i++) out->data[i] = out->data[start + i];
+  (*pos) = sink->flushed = keep;
+  return 0;
+}
+
 /*get the tree of a deflated block with fixed tree, as specified in the deflate specification*/
 static void getTreeInflateFixed(HuffmanTree* tree_ll, HuffmanTree* tree_d)
 {
@@ -1110,7 +1152,7 @@ static unsigned getTreeInflateDynamic(HuffmanTree* tree_ll, HuffmanTree* tree_d,
 
 /*inflate a block with dynamic of fixed Huffman tree*/
 static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size_t* bp,
-                                    size_t* pos, size_t inlength, unsigned btype)
+                                    size_t* pos, size_t inlength, unsigned btype, InflateSink* sink)
 {
   unsigned error = 0;
   HuffmanTree tree_ll; /*the huffman tree for literal and length codes*/
@@ -1126,7 +1168,13 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   while(!error) /*decode all symbols until end reached, breaks at end code*/
   {
     /*code_ll is literal, length or end code*/
-    unsigned code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
+    unsigned code_ll;
+    if(sink && (*pos) >= INFLATE_WINDOW_SIZE + INFLATE_FLUSH_SIZE)
+    {
+      error = inflateSlideWindow(sink, out, pos);
+      if(error) break;
+    }
+    code_ll = huffmanDecodeSymbol(in, bp, &tree_ll, inbitlength);
     if(code_ll <= 255) /*literal symbol*/
     {
       if((*pos) >= out->size)
@@ -1209,7 +1257,8 @@ static unsigned inflateHuffmanBlock(ucvector* out, const unsigned char* in, size
   return error;
 }
 
-static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength)
+static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, size_t* bp, size_t* pos, size_t inlength,
+                                     InflateSink* sink)
 {
   /*go to first boundary of byte*/
   size_t p;
@@ -1225,6 +1274,12 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
   /*check if 16-bit NLEN is really the one's complement of LEN*/
   if(LEN + NLEN != 65535) return 21; /*error: NLEN is not one's complement of LEN*/
 
+  if(sink && (*pos) + LEN >= INFLATE_WINDOW_SIZE + INFLATE_FLUSH_SIZE)
+  {
+    error = inflateSlideWindow(sink, out, pos);
+    if(error) return error;
+  }
+
   if((*pos) + LEN >= out->size)
   {
     if(!ucvector_resize(out, (*pos) + LEN)) return 83; /*alloc fail*/
@@ -1239,9 +1294,8 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
   return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
-                                 const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings)
+/*inflate into out, or through the window in out if sink is not NULL*/
+static unsigned inflatev_sink(ucvector* out, const unsigned char* in, size_t insize, InflateSink* sink)
 {
   /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
   size_t bp = 0;
@@ -1250,8 +1304,6 @@ static unsigned lodepng_inflatev(ucvector* out,
 
   unsigned error = 0;
 
-  (void)settings;
-
   while(!BFINAL)
   {
     unsigned BTYPE;
@@ -1261,18 +1313,29 @@ static unsigned lodepng_inflatev(ucvector* out,
     BTYPE += 2 * readBitFromStream(&bp, in);
 
     if(BTYPE == 3) return 20; /*error: invalid BTYPE*/
-    else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
-    else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
+    else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize, sink); /*no compression*/
+    else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE, sink); /*compression, BTYPE 01 or 10*/
 
     if(error) return error;
   }
 
+  /*hand the remainder of the window to the sink*/
+  if(sink) return inflateFlush(sink, out, pos);
+
   /*Only now we know the true size of out, resize it to that*/
   if(!ucvector_resize(out, pos)) error = 83; /*alloc fail*/
 
   return error;
 }
 
+static unsigned lodepng_inflatev(ucvector* out,
+                                 const unsigned char* in, size_t insize,
+                                 const LodePNGDecompressSettings* settings)
+{
+  (void)settings;
+  return inflatev_sink(out, in, insize, 0);
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings)
@@ -2076,10 +2139,9 @@ static unsigned adler32(const unsigned char* data, unsigned len)
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings)
+/*check the 2-byte zlib header at the start of in*/
+static unsigned zlib_check_header(const unsigned char* in, size_t insize)
 {
-  unsigned error = 0;
   unsigned CM, CINFO, FDICT;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -2108,6 +2170,15 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
     return 26;
   }
 
+  return 0;
+}
+
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings)
+{
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
+
   error = inflate(out, outsize, in + 2, insize - 2, settings);
   if(error) return error;
 
@@ -2130,6 +2201,36 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
     return lodepng_zlib_decompress(out, outsize, in, insize, settings);
 }
 
+/*rEFInd addition: decompress a zlib stream through a sliding window, handing the output
+to the sink piece by piece. Custom zlib and inflate functions are not used here.*/
+static unsigned zlib_decompress_sink(const unsigned char* in, size_t insize,
+                                     const LodePNGDecompressSettings* settings, InflateSink* sink)
+{
+  ucvector window;
+  unsigned char* data;
+  size_t windowsize = INFLATE_WINDOW_SIZE + INFLATE_FLUSH_SIZE + 65536; /*room for one stored block*/
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
+
+  data = (unsigned char*)lodepng_malloc(windowsize);
+  if(!data) return 83; /*alloc fail*/
+  ucvector_init_buffer(&window, data, windowsize);
+
+  sink->flushed = 0;
+  sink->adler = 1;
+  error = inflatev_sink(&window, in + 2, insize - 2, sink);
+  lodepng_free(window.data);
+  if(error) return error;
+
+  if(!settings->ignore_adler32)
+  {
+    if(insize < 6) return 53; /*error, size of zlib data too small*/
+    if(sink->adler != lodepng_read32bitInt(&in[insize - 4])) return 58; /*error, adler checksum not correct*/
+  }
+
+  return 0; /*no error*/
+}
+
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -4552,14 +4653,13 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
 /*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*read all chunks following the header (which lodepng_inspect must already have read),
+collecting the data of the IDAT chunks in idat*/
+static void decodeChunks(ucvector* idat, LodePNGState* state, const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
   size_t i;
-  ucvector idat; /*the data from idat chunks*/
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4567,13 +4667,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
-
-  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
-  if(state->error) return;
-
-  ucvector_init(&idat);
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4601,9 +4694,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     /*IDAT chunk, containing compressed image data*/
     if(lodepng_chunk_type_equals(chunk, "IDAT"))
     {
-      size_t oldsize = idat.size;
-      if(!ucvector_resize(&idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
-      for(i = 0; i < chunkLength; i++) idat.data[oldsize + i] = data[i];
+      size_t oldsize = idat->size;
+      if(!ucvector_resize(idat, oldsize + chunkLength)) CERROR_BREAK(state->error, 83 /*alloc fail*/);
+      for(i = 0; i < chunkLength; i++) idat->data[oldsize + i] = data[i];
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       critical_pos = 3;
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
@@ -4696,6 +4789,22 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
+}
+
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  ucvector idat; /*the data from idat chunks*/
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
+  if(state->error) return;
+
+  ucvector_init(&idat);
+  decodeChunks(&idat, state, in, insize);
 
   if(!state->error)
   {
@@ -4773,6 +4882,179 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
   return state->error;
 }
 
+/*turn RGBA pixels into BGRA pixels in place*/
+static void swapRedBlue(unsigned char* pixels, size_t numpixels)
+{
+  size_t i;
+  for(i = 0; i < numpixels; i++, pixels += 4)
+  {
+    unsigned char red = pixels[0];
+    pixels[0] = pixels[2];
+    pixels[2] = red;
+  }
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*rEFInd addition: scanline consumer for lodepng_decode_bgra. It gathers the inflated
+data one filtered scanline at a time, unfilters it against the previous scanline and
+converts it straight into its row of the BGRA output, or into a single row buffer that
+is handed to a callback.*/
+typedef struct BGRARowSink
+{
+  unsigned char* out; /*w * h pixels of 4 bytes each, in B, G, R, A order, or NULL*/
+  unsigned char* row; /*if out is NULL: one row of w pixels for the callback*/
+  LodePNGRowCallback callback;
+  void* context;
+  unsigned w, h;
+  unsigned y; /*next row to produce*/
+  size_t linebytes; /*bytes of a scanline, excluding the filter type byte*/
+  size_t bytewidth; /*filter unit: bytes per pixel, but at least 1*/
+  size_t linepos; /*bytes of the current scanline (with filter type byte) received so far*/
+  unsigned char* scanline; /*current filtered scanline, 1 + linebytes bytes*/
+  unsigned char* lines; /*current and previous unfiltered scanline, linebytes bytes each*/
+  const LodePNGColorMode* mode;
+  unsigned fix_png;
+} BGRARowSink;
+
+static unsigned bgraRowSink_flush(void* context, const unsigned char* data, size_t size)
+{
+  BGRARowSink* sink = (BGRARowSink*)context;
+  while(size > 0 && sink->y < sink->h) /*data after the last scanline is ignored*/
+  {
+    size_t i, amount = 1 + sink->linebytes - sink->linepos;
+    if(amount > size) amount = size;
+    for(i = 0; i < amount; i++) sink->scanline[sink->linepos + i] = data[i];
+    sink->linepos += amount;
+    data += amount;
+    size -= amount;
+
+    if(sink->linepos == 1 + sink->linebytes)
+    {
+      unsigned char* recon = &sink->lines[(sink->y & 1) * sink->linebytes];
+      unsigned char* precon = sink->y ? &sink->lines[((sink->y + 1) & 1) * sink->linebytes] : 0;
+      unsigned char* row = sink->out ? &sink->out[(size_t)sink->y * sink->w * 4] : sink->row;
+
+      CERROR_TRY_RETURN(unfilterScanline(recon, &sink->scanline[1], precon, sink->bytewidth,
+                                         sink->scanline[0], sink->linebytes));
+      CERROR_TRY_RETURN(getPixelColorsRGBA8(row, sink->w, 1, recon, sink->mode, sink->fix_png));
+      swapRedBlue(row, sink->w);
+      if(!sink->out) CERROR_TRY_RETURN(sink->callback(sink->context, sink->y, row));
+      sink->linepos = 0;
+      sink->y++;
+    }
+  }
+  return 0;
+}
+
+static unsigned decodeBGRAStreaming(unsigned char* out, LodePNGRowCallback callback, void* context,
+                                    unsigned w, unsigned h, LodePNGState* state, const ucvector* idat)
+{
+  unsigned error;
+  unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+  BGRARowSink rows;
+  InflateSink sink;
+
+  if(bpp == 0) return 31; /*error: invalid colortype*/
+
+  rows.out = out;
+  rows.callback = callback;
+  rows.context = context;
+  rows.w = w;
+  rows.h = h;
+  rows.y = 0;
+  rows.linebytes = ((size_t)w * bpp + 7) / 8;
+  rows.bytewidth = (bpp + 7) / 8;
+  rows.linepos = 0;
+  rows.mode = &state->info_png.color;
+  rows.fix_png = state->decoder.fix_png;
+  rows.scanline = (unsigned char*)lodepng_malloc(1 + rows.linebytes);
+  rows.lines = (unsigned char*)lodepng_malloc(2 * rows.linebytes);
+  rows.row = out ? 0 : (unsigned char*)lodepng_malloc((size_t)w * 4);
+
+  if(!rows.scanline || !rows.lines || (!out && !rows.row)) error = 83; /*alloc fail*/
+  else
+  {
+    sink.flush = bgraRowSink_flush;
+    sink.context = &rows;
+    error = zlib_decompress_sink(idat->data, idat->size, &state->decoder.zlibsettings, &sink);
+    if(!error && rows.y < h) error = 90; /*error: image data ended before the last scanline*/
+  }
+
+  lodepng_free(rows.scanline);
+  lodepng_free(rows.lines);
+  lodepng_free(rows.row);
+  return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*decode into out if it isn't NULL, or else pass the image to callback row by row*/
+static unsigned decodeBGRA(unsigned char* out, LodePNGRowCallback callback, void* context,
+                           unsigned w, unsigned h, LodePNGState* state,
+                           const unsigned char* in, size_t insize)
+{
+  unsigned pngw, pngh;
+
+  state->error = lodepng_inspect(&pngw, &pngh, state, in, insize);
+  if(state->error) return state->error;
+  if(pngw != w || pngh != h) CERROR_RETURN_ERROR(state->error, 91); /*error: wrong size of output buffer*/
+
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(state->info_png.interlace_method == 0 && !state->decoder.zlibsettings.custom_zlib
+     && !state->decoder.zlibsettings.custom_inflate)
+  {
+    ucvector idat;
+    ucvector_init(&idat);
+    decodeChunks(&idat, state, in, insize);
+    if(!state->error) state->error = decodeBGRAStreaming(out, callback, context, w, h, state, &idat);
+    ucvector_cleanup(&idat);
+    return state->error;
+  }
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+  /*Adam7 interlaced images can't be handled a scanline at a time: decode the whole raw
+  image, then convert it into the output buffer (or a temporary one for the callback)*/
+  {
+    unsigned char* raw;
+    unsigned char* image = out;
+    LodePNGColorMode rgba;
+    unsigned y;
+
+    decodeGeneric(&raw, &pngw, &pngh, state, in, insize);
+    if(!state->error && !image)
+    {
+      image = (unsigned char*)lodepng_malloc((size_t)w * h * 4);
+      if(!image) state->error = 83; /*alloc fail*/
+    }
+    if(!state->error)
+    {
+      lodepng_color_mode_init(&rgba); /*8-bit RGBA*/
+      state->error = lodepng_convert(image, raw, &rgba, &state->info_png.color, w, h, state->decoder.fix_png);
+      if(!state->error) swapRedBlue(image, (size_t)w * h);
+    }
+    for(y = 0; !out && !state->error && y < h; y++)
+    {
+      state->error = callback(context, y, &image[(size_t)y * w * 4]);
+    }
+    if(!out) lodepng_free(image);
+    lodepng_free(raw);
+  }
+  return state->error;
+}
+
+unsigned lodepng_decode_bgra(unsigned char* out, unsigned w, unsigned h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize)
+{
+  return decodeBGRA(out, 0, 0, w, h, state, in, insize);
+}
+
+unsigned lodepng_decode_bgra_rows(LodePNGRowCallback callback, void* context,
+                                  unsigned w, unsigned h, LodePNGState* state,
+                                  const unsigned char* in, size_t insize)
+{
+  return decodeBGRA(0, callback, context, w, h, state, in, insize);
+}
+
 unsigned lodepng_decode_memory(unsigned char** out, unsigned* w, unsigned* h, const unsigned char* in,
                                size_t insize, LodePNGColorType colortype, unsigned bitdepth)
 {
@@ -6014,6 +6296,8 @@ const char* lodepng_error_text(unsigned code)
     case 87: return "must provide custom zlib function pointer if LODEPNG_COMPILE_ZLIB is not defined";
     case 88: return "invalid filter strategy given for LodePNGEncoderSettings.filter_strategy";
     case 89: return "text chunk keyword too short or long: must have size 1-79";
+    case 90: return "image data ended before the last scanline";
+    case 91: return "size of the output buffer doesn't match the size of the image";
   }
   return "unknown error code";
 }
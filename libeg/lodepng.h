@@ -654,6 +654,27 @@ information is placed in the info_png field of the LodePNGState.
 unsigned lodepng_inspect(unsigned* w, unsigned* h,
                          LodePNGState* state,
                          const unsigned char* in, size_t insize);
+
+/*
+rEFInd addition: decode the PNG into a caller-supplied buffer of w * h 32-bit pixels
+in B, G, R, A byte order, as used by EFI. w and h must be the values returned by
+lodepng_inspect. Non-interlaced images are inflated through a small sliding window and
+converted one scanline at a time, so no full-size intermediate buffers are allocated.
+*/
+unsigned lodepng_decode_bgra(unsigned char* out, unsigned w, unsigned h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize);
+
+/*
+rEFInd addition: like lodepng_decode_bgra, but instead of filling a whole image, hands
+each decoded row of w BGRA pixels to callback, in order from top to bottom. The row
+buffer is reused for the next row. A non-zero return value from callback aborts
+decoding and is returned as the error code.
+*/
+typedef unsigned (*LodePNGRowCallback)(void* context, unsigned y, const unsigned char* row);
+unsigned lodepng_decode_bgra_rows(LodePNGRowCallback callback, void* context,
+                                  unsigned w, unsigned h, LodePNGState* state,
+                                  const unsigned char* in, size_t insize);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 
@@ -10,6 +10,7 @@
 
 #include "global.h"
 #include "../refind/screen.h"
+#include "../refind/lib.h"
 #include "lodepng.h"
 
 // EFI's equivalent of realloc requires the original buffer's size as an
@@ -20,11 +21,15 @@
 // interchangeable with the standard EFI functions; memory allocated via
 // lodepng_malloc() should be freed via lodepng_free(), and myfree() should
 // NOT be used with memory allocated via AllocatePool() or AllocateZeroPool()!
+// The stored size is the capacity of the block, so lodepng_realloc() can
+// shrink or re-grow a buffer in place; LodePNG's vectors already double
+// their allocation when they grow, so most calls never reach the pool.
+// LodePNG initializes everything it uses, so the memory isn't zeroed.
 
 void* lodepng_malloc(size_t size) {
    void *ptr;
 
-   ptr = AllocateZeroPool(size + sizeof(size_t));
+   ptr = AllocatePool(size + sizeof(size_t));
    if (ptr) {
       *(size_t *) ptr = size;
       return ((size_t *) ptr) + 1;
@@ -51,10 +56,14 @@ void* lodepng_realloc(void *ptr, size_t new_size) {
    size_t *new_pool;
    size_t old_size;
 
+   old_size = report_size(ptr);
+   if (ptr && (new_size <= old_size))
+      return ptr;
+
    new_pool = lodepng_malloc(new_size);
    if (new_pool && ptr) {
-      old_size = report_size(ptr);
-      CopyMem(new_pool, ptr, (old_size < new_size) ? old_size : new_size);
+      CopyMem(new_pool, ptr, old_size);
+      lodepng_free(ptr);
    }
    return new_pool;
 } // lodepng_realloc()
@@ -70,44 +79,121 @@ int MyStrlen(const char *InString) {
    return Length;
 } // int MyStrlen()
 
-typedef struct _lode_color {
-   UINT8 red;
-   UINT8 green;
-   UINT8 blue;
-   UINT8 alpha;
-} lode_color;
-
+// Decodes a PNG file into a new EG_IMAGE. LodePNG writes the pixels directly
+// into the image's PixelData in EFI's BGRA order, so no full-size RGBA copy
+// of the image is ever allocated.
 EG_IMAGE * egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha) {
    EG_IMAGE *NewImage = NULL;
+   LodePNGState State;
    unsigned Error, Width, Height;
-   EG_PIXEL *PixelData;
-   lode_color *LodeData;
-   UINTN i;
 
-   Error = lodepng_decode_memory((unsigned char **) &PixelData, &Width, &Height, (unsigned char*) FileData,
-                                 (size_t) FileDataLength, LCT_RGBA, 8);
+   lodepng_state_init(&State);
+   Error = lodepng_inspect(&Width, &Height, &State, (unsigned char *) FileData, (size_t) FileDataLength);
 
-   if (Error) {
-      return NULL;
+   // allocate image structure and buffer
+   if (!Error)
+      NewImage = egCreateImage(Width, Height, WantAlpha);
+   if (NewImage != NULL) {
+      Error = lodepng_decode_bgra((unsigned char *) NewImage->PixelData, Width, Height, &State,
+                                  (unsigned char *) FileData, (size_t) FileDataLength);
+      if (Error) {
+         egFreeImage(NewImage);
+         NewImage = NULL;
+      }
    }
+   lodepng_state_cleanup(&State);
 
-   // allocate image structure and buffer
-   NewImage = egCreateImage(Width, Height, WantAlpha);
-   if ((NewImage == NULL) || (NewImage->Width != Width) || (NewImage->Height != Height))
+   return NewImage;
+} // EG_IMAGE * egDecodePNG()
+
+// State for downscaling a PNG while it's being decoded; see egDecodeScaledPNG().
+typedef struct {
+   EG_IMAGE *Image;         // destination image
+   UINTN    SrcWidth;
+   UINTN    SrcHeight;
+   UINTN    *ColumnMap;     // destination column of each source column
+   UINTN    *ColumnCount;   // number of source columns summed into each destination column
+   UINTN    *Sums;          // b, g, r and a sums for each destination column of the current row
+   UINTN    RowsSummed;     // number of source rows summed into Sums so far
+} PNG_SCALE_STATE;
+
+// Adds one decoded source row to the running sums, and emits a destination
+// row when the last source row that maps to it has been added.
+static unsigned ScalePNGRow(void *Context, unsigned y, const unsigned char *Row) {
+   PNG_SCALE_STATE *State = (PNG_SCALE_STATE *) Context;
+   EG_PIXEL        *DestPtr;
+   UINTN           x, Column, Count, DestY, DestHeight;
+   UINTN           *Sum;
+
+   for (x = 0; x < State->SrcWidth; x++, Row += 4) {
+      Sum = &State->Sums[State->ColumnMap[x] * 4];
+      Sum[0] += Row[0];
+      Sum[1] += Row[1];
+      Sum[2] += Row[2];
+      Sum[3] += Row[3];
+   }
+   State->RowsSummed++;
+
+   DestHeight = State->Image->Height;
+   DestY = ((UINTN) y * DestHeight) / State->SrcHeight;
+   if ((y + 1 == State->SrcHeight) || ((((UINTN) y + 1) * DestHeight) / State->SrcHeight != DestY)) {
+      DestPtr = State->Image->PixelData + DestY * State->Image->Width;
+      for (Column = 0; Column < State->Image->Width; Column++, DestPtr++) {
+         Sum = &State->Sums[Column * 4];
+         Count = State->ColumnCount[Column] * State->RowsSummed;
+         DestPtr->b = (UINT8) ((Sum[0] + Count / 2) / Count);
+         DestPtr->g = (UINT8) ((Sum[1] + Count / 2) / Count);
+         DestPtr->r = (UINT8) ((Sum[2] + Count / 2) / Count);
+         DestPtr->a = (UINT8) ((Sum[3] + Count / 2) / Count);
+      }
+      ZeroMem(State->Sums, State->Image->Width * 4 * sizeof(UINTN));
+      State->RowsSummed = 0;
+   }
+   return 0;
+} // static unsigned ScalePNGRow()
+
+// Decodes a PNG file for use as an IconSize x IconSize icon. If the PNG is at
+// least that large in both dimensions, each decoded row is averaged straight
+// into the icon, so the full-size image is never stored. Otherwise, the image
+// is decoded at its native size, and the caller must scale it up.
+EG_IMAGE * egDecodeScaledPNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha) {
+   PNG_SCALE_STATE State;
+   LodePNGState    PNGState;
+   unsigned        Error, Width, Height;
+   UINTN           x;
+
+   lodepng_state_init(&PNGState);
+   Error = lodepng_inspect(&Width, &Height, &PNGState, (unsigned char *) FileData, (size_t) FileDataLength);
+   lodepng_state_cleanup(&PNGState);
+   if (Error || (IconSize == 0) || (Width < IconSize) || (Height < IconSize) ||
+       ((Width == IconSize) && (Height == IconSize)))
+      return egDecodePNG(FileData, FileDataLength, IconSize, WantAlpha);
+
+   State.SrcWidth = Width;
+   State.SrcHeight = Height;
+   State.RowsSummed = 0;
+   State.Image = egCreateImage(IconSize, IconSize, WantAlpha);
+   State.ColumnMap = AllocatePool(Width * sizeof(UINTN));
+   State.ColumnCount = AllocateZeroPool(IconSize * sizeof(UINTN));
+   State.Sums = AllocateZeroPool(IconSize * 4 * sizeof(UINTN));
+   Error = 83; // lodepng's "memory allocation failed"
+   if (State.Image && State.ColumnMap && State.ColumnCount && State.Sums) {
+      for (x = 0; x < Width; x++) {
+         State.ColumnMap[x] = (x * IconSize) / Width;
+         State.ColumnCount[State.ColumnMap[x]]++;
+      }
+      lodepng_state_init(&PNGState);
+      Error = lodepng_decode_bgra_rows(ScalePNGRow, &State, Width, Height, &PNGState,
+                                       (unsigned char *) FileData, (size_t) FileDataLength);
+      lodepng_state_cleanup(&PNGState);
+   }
+   MyFreePool(State.ColumnMap);
+   MyFreePool(State.ColumnCount);
+   MyFreePool(State.Sums);
+   if (Error) {
+      egFreeImage(State.Image);
       return NULL;
-
-   LodeData = (lode_color *) PixelData;
-
-   // Annoyingly, EFI and LodePNG use different ordering of RGB values in
-   // their pixel data representations, so we've got to adjust them....
-   for (i = 0; i < (NewImage->Height * NewImage->Width); i++) {
-      NewImage->PixelData[i].r = LodeData[i].red;
-      NewImage->PixelData[i].g = LodeData[i].green;
-      NewImage->PixelData[i].b = LodeData[i].blue;
-      if (WantAlpha)
-         NewImage->PixelData[i].a = LodeData[i].alpha;
    }
-   lodepng_free(PixelData);
 
-   return NewImage;
-} // EG_IMAGE * egDecodePNG()
\ No newline at end of file
+   return State.Image;
+} // EG_IMAGE * egDecodeScaledPNG()
@@ -325,6 +325,77 @@ VOID egSetGraphicsModeEnabled(IN BOOLEAN Enable)
 // Drawing to the screen
 //
 
+// Returns a pointer to the GOP linear frame buffer if the user has asked for
+// direct frame buffer access (use_linear_framebuffer) and the current mode
+// can safely be written that way; otherwise returns NULL, in which case the
+// caller should fall back on the firmware's Blt() function. The mode is
+// checked on every call because egSetScreenSize() may have changed it.
+static UINT32 * egLinearFrameBuffer(VOID)
+{
+    EFI_GRAPHICS_OUTPUT_MODE_INFORMATION *Info;
+
+    if (!GlobalConfig.UseLinearFramebuffer || (GraphicsOutput == NULL) || (GraphicsOutput->Mode == NULL))
+        return NULL;
+
+    Info = GraphicsOutput->Mode->Info;
+    if ((Info == NULL) || (GraphicsOutput->Mode->FrameBufferBase == 0) ||
+        ((Info->PixelFormat != PixelBlueGreenRedReserved8BitPerColor) &&
+         (Info->PixelFormat != PixelRedGreenBlueReserved8BitPerColor)) ||
+        (Info->HorizontalResolution != egScreenWidth) || (Info->VerticalResolution != egScreenHeight) ||
+        (Info->PixelsPerScanLine < Info->HorizontalResolution) ||
+        (GraphicsOutput->Mode->FrameBufferSize < (UINTN) Info->PixelsPerScanLine * Info->VerticalResolution * 4))
+        return NULL;
+
+    return (UINT32 *) (UINTN) GraphicsOutput->Mode->FrameBufferBase;
+} // static UINT32 * egLinearFrameBuffer()
+
+// Copy a Width x Height area from Source, whose rows are SourceDelta pixels
+// apart, to the linear frame buffer at (ScreenPosX, ScreenPosY). Each row is
+// written exactly once and the frame buffer is never read, since reads from
+// video memory are very slow on most hardware. Pixels are converted from
+// EG_PIXEL (BGRx) order if the frame buffer uses RGBx order. If Source is
+// NULL, the area is filled with FillColor instead. Returns TRUE if the area
+// was drawn, FALSE if the caller must use Blt() instead.
+static BOOLEAN egLinearBlt(IN EG_PIXEL *Source, IN UINTN SourceDelta, IN EG_PIXEL *FillColor,
+                           IN UINTN ScreenPosX, IN UINTN ScreenPosY, IN UINTN Width, IN UINTN Height)
+{
+    UINT32   *FrameBuffer, *Dest, Fill = 0;
+    EG_PIXEL *Src;
+    UINTN    Stride, x, y;
+    BOOLEAN  SwapRedBlue;
+
+    FrameBuffer = egLinearFrameBuffer();
+    if ((FrameBuffer == NULL) || (ScreenPosX > egScreenWidth) || (ScreenPosY > egScreenHeight) ||
+        (Width > egScreenWidth - ScreenPosX) || (Height > egScreenHeight - ScreenPosY))
+        return FALSE;
+
+    Stride = GraphicsOutput->Mode->Info->PixelsPerScanLine;
+    SwapRedBlue = (GraphicsOutput->Mode->Info->PixelFormat == PixelRedGreenBlueReserved8BitPerColor);
+    if (FillColor != NULL) {
+        if (SwapRedBlue)
+            Fill = ((UINT32) FillColor->b << 16) | ((UINT32) FillColor->g << 8) | FillColor->r;
+        else
+            Fill = ((UINT32) FillColor->r << 16) | ((UINT32) FillColor->g << 8) | FillColor->b;
+    }
+
+    for (y = 0; y < Height; y++) {
+        Dest = FrameBuffer + (ScreenPosY + y) * Stride + ScreenPosX;
+        if (Source == NULL) {
+            for (x = 0; x < Width; x++)
+                Dest[x] = Fill;
+        } else {
+            Src = Source + y * SourceDelta;
+            if (SwapRedBlue) {
+                for (x = 0; x < Width; x++)
+                    Dest[x] = ((UINT32) Src[x].b << 16) | ((UINT32) Src[x].g << 8) | Src[x].r;
+            } else {
+                CopyMem(Dest, Src, Width * 4);
+            }
+        }
+    }
+    return TRUE;
+} // static BOOLEAN egLinearBlt()
+
 VOID egClearScreen(IN EG_PIXEL *Color)
 {
     EFI_UGA_PIXEL FillColor;
@@ -343,7 +414,9 @@ VOID egClearScreen(IN EG_PIXEL *Color)
     }
     FillColor.Reserved = 0;
 
-    if (GraphicsOutput != NULL) {
+    if (egLinearBlt(NULL, 0, (EG_PIXEL *) &FillColor, 0, 0, egScreenWidth, egScreenHeight)) {
+        // drawn directly to the frame buffer
+    } else if (GraphicsOutput != NULL) {
         // EFI_GRAPHICS_OUTPUT_BLT_PIXEL and EFI_UGA_PIXEL have the same
         // layout, and the header from TianoCore actually defines them
         // to be the same type.
@@ -378,7 +451,10 @@ VOID egDrawImage(IN EG_IMAGE *Image, IN UINTN ScreenPosX, IN UINTN ScreenPosY)
        egComposeImage(CompImage, Image, 0, 0);
     }
 
-    if (GraphicsOutput != NULL) {
+    if (egLinearBlt(CompImage->PixelData, CompImage->Width, NULL, ScreenPosX, ScreenPosY,
+                    CompImage->Width, CompImage->Height)) {
+       // drawn directly to the frame buffer
+    } else if (GraphicsOutput != NULL) {
        refit_call10_wrapper(GraphicsOutput->Blt, GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)CompImage->PixelData,
                             EfiBltBufferToVideo, 0, 0, ScreenPosX, ScreenPosY, CompImage->Width, CompImage->Height, 0);
     } else if (UgaDraw != NULL) {
@@ -414,7 +490,10 @@ VOID egDrawImageArea(IN EG_IMAGE *Image,
     if (AreaWidth == 0)
         return;
 
-    if (GraphicsOutput != NULL) {
+    if (egLinearBlt(Image->PixelData + AreaPosY * Image->Width + AreaPosX, Image->Width, NULL,
+                    ScreenPosX, ScreenPosY, AreaWidth, AreaHeight)) {
+        // drawn directly to the frame buffer
+    } else if (GraphicsOutput != NULL) {
         refit_call10_wrapper(GraphicsOutput->Blt, GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->PixelData,
                              EfiBltBufferToVideo, AreaPosX, AreaPosY, ScreenPosX, ScreenPosY, AreaWidth, AreaHeight,
                              Image->Width * 4);
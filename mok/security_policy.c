@@ -56,6 +56,35 @@ struct _EFI_SECURITY_PROTOCOL {
 static EFI_SECURITY_FILE_AUTHENTICATION_STATE esfas = NULL;
 static EFI_SECURITY2_FILE_AUTHENTICATION es2fa = NULL;
 
+// An image that the caller has already read into memory and is about to pass
+// to LoadImage(); see security_policy_set_image()
+static EFI_DEVICE_PATH *preloaded_path = NULL;
+static VOID *preloaded_buffer = NULL;
+static UINTN preloaded_size = 0;
+
+// Tell security_policy_authentication() that the file at DevicePath has already
+// been read into Buffer, so that it needn't read it again. Pass NULL values to
+// forget about it once LoadImage() has returned.
+VOID
+security_policy_set_image(EFI_DEVICE_PATH *DevicePath, VOID *Buffer, UINTN Size)
+{
+   preloaded_path = DevicePath;
+   preloaded_buffer = Buffer;
+   preloaded_size = Size;
+} // VOID security_policy_set_image()
+
+// Returns TRUE if DevicePath is the path given to security_policy_set_image()
+static BOOLEAN
+is_preloaded_image(const EFI_DEVICE_PATH_PROTOCOL *DevicePath)
+{
+   UINTN Size;
+
+   if ((preloaded_path == NULL) || (preloaded_buffer == NULL) || (DevicePath == NULL))
+      return FALSE;
+   Size = DevicePathSize((EFI_DEVICE_PATH *) DevicePath);
+   return ((Size == DevicePathSize(preloaded_path)) && (CompareMem(DevicePath, preloaded_path, Size) == 0));
+} // static BOOLEAN is_preloaded_image()
+
 // Perform shim/MOK and Secure Boot authentication on a binary that's already been
 // loaded into memory. This function does the platform SB authentication first
 // but preserves its return value in case of its failure, so that it can be
@@ -111,6 +140,11 @@ security_policy_authentication (
 
    if (DevicePathConst == NULL) {
       return EFI_INVALID_PARAMETER;
+   } else if (is_preloaded_image(DevicePathConst)) {
+      // rEFInd has already read the file; no need to do so again....
+      if (ShimValidate(preloaded_buffer, preloaded_size))
+         return EFI_SUCCESS;
+      return uefi_call_wrapper(esfas, 3, This, AuthenticationStatus, DevicePathConst);
    } else {
       DevPath = OrigDevPath = DuplicateDevicePath((EFI_DEVICE_PATH *)DevicePathConst);
    }
@@ -2,5 +2,7 @@ EFI_STATUS
 security_policy_install(void);
 EFI_STATUS
 security_policy_uninstall(void);
+VOID
+security_policy_set_image(EFI_DEVICE_PATH *DevicePath, VOID *Buffer, UINTN Size);
 // void
 // security_protocol_set_hashes(unsigned char *esl, int len);
@@ -49,6 +49,7 @@
 #include "menu.h"
 #include "config.h"
 #include "screen.h"
+#include "crc32.h"
 #include "../include/refit_call_wrapper.h"
 #include "../mok/mok.h"
 
@@ -61,25 +62,137 @@
 #define ENCODING_UTF8       (1)
 #define ENCODING_UTF16_LE   (2)
 
+#define TOKEN_LIST_INCREMENT (16)
+
 #define GetTime ST->RuntimeServices->GetTime
 #define LAST_MINUTE 1439 /* Last minute of a day */
 
 static REFIT_MENU_ENTRY MenuEntryReturn   = { L"Return to Main Menu", TAG_RETURN, 0, 0, 0, NULL, NULL, NULL };
 
+// Configuration file keywords, as returned by ConfigKeyword()
+#define KW_UNKNOWN                   (0)
+#define KW_TIMEOUT                   (1)
+#define KW_HIDEUI                    (2)
+#define KW_ICONS_DIR                 (3)
+#define KW_SCANFOR                   (4)
+#define KW_UEFI_DEEP_LEGACY_SCAN     (5)
+#define KW_USE_LINEAR_FRAMEBUFFER    (6)
+#define KW_SCAN_DELAY                (7)
+#define KW_ALSO_SCAN_DIRS            (8)
+#define KW_DONT_SCAN_VOLUMES         (9)
+#define KW_DONT_SCAN_DIRS            (10)
+#define KW_DONT_SCAN_FILES           (11)
+#define KW_WINDOWS_RECOVERY_FILES    (12)
+#define KW_SCAN_DRIVER_DIRS          (13)
+#define KW_SHOWTOOLS                 (14)
+#define KW_BANNER                    (15)
+#define KW_BANNER_SCALE              (16)
+#define KW_SMALL_ICON_SIZE           (17)
+#define KW_BIG_ICON_SIZE             (18)
+#define KW_SELECTION_SMALL           (19)
+#define KW_SELECTION_BIG             (20)
+#define KW_DEFAULT_SELECTION         (21)
+#define KW_TEXTONLY                  (22)
+#define KW_TEXTMODE                  (23)
+#define KW_RESOLUTION                (24)
+#define KW_SCREENSAVER               (25)
+#define KW_USE_GRAPHICS_FOR          (26)
+#define KW_FONT                      (27)
+#define KW_SCAN_ALL_LINUX_KERNELS    (28)
+#define KW_MAX_TAGS                  (29)
+#define KW_INCLUDE                   (30)
+#define KW_TARGETED_DRIVER_CONNECT   (31)
+#define KW_SORT_BY                   (32)
+
+typedef struct {
+   CHAR16  *Name;
+   UINTN   Id;
+} CONFIG_KEYWORD;
+
+static CONFIG_KEYWORD ConfigKeywords[] = {
+   { L"timeout",                 KW_TIMEOUT },
+   { L"hideui",                  KW_HIDEUI },
+   { L"icons_dir",               KW_ICONS_DIR },
+   { L"scanfor",                 KW_SCANFOR },
+   { L"uefi_deep_legacy_scan",   KW_UEFI_DEEP_LEGACY_SCAN },
+   { L"use_linear_framebuffer",  KW_USE_LINEAR_FRAMEBUFFER },
+   { L"scan_delay",              KW_SCAN_DELAY },
+   { L"also_scan_dirs",          KW_ALSO_SCAN_DIRS },
+   { L"don't_scan_volumes",      KW_DONT_SCAN_VOLUMES },
+   { L"dont_scan_volumes",       KW_DONT_SCAN_VOLUMES },
+   { L"don't_scan_dirs",         KW_DONT_SCAN_DIRS },
+   { L"dont_scan_dirs",          KW_DONT_SCAN_DIRS },
+   { L"don't_scan_files",        KW_DONT_SCAN_FILES },
+   { L"dont_scan_files",         KW_DONT_SCAN_FILES },
+   { L"windows_recovery_files",  KW_WINDOWS_RECOVERY_FILES },
+   { L"scan_driver_dirs",        KW_SCAN_DRIVER_DIRS },
+   { L"targeted_driver_connect", KW_TARGETED_DRIVER_CONNECT },
+   { L"showtools",               KW_SHOWTOOLS },
+   { L"banner",                  KW_BANNER },
+   { L"banner_scale",            KW_BANNER_SCALE },
+   { L"small_icon_size",         KW_SMALL_ICON_SIZE },
+   { L"big_icon_size",           KW_BIG_ICON_SIZE },
+   { L"selection_small",         KW_SELECTION_SMALL },
+   { L"selection_big",           KW_SELECTION_BIG },
+   { L"default_selection",       KW_DEFAULT_SELECTION },
+   { L"textonly",                KW_TEXTONLY },
+   { L"textmode",                KW_TEXTMODE },
+   { L"resolution",              KW_RESOLUTION },
+   { L"screensaver",             KW_SCREENSAVER },
+   { L"use_graphics_for",        KW_USE_GRAPHICS_FOR },
+   { L"font",                    KW_FONT },
+   { L"scan_all_linux_kernels",  KW_SCAN_ALL_LINUX_KERNELS },
+   { L"sort_by",                 KW_SORT_BY },
+   { L"max_tags",                KW_MAX_TAGS },
+   { L"include",                 KW_INCLUDE }
+};
+
+#define NUM_CONFIG_KEYWORDS (sizeof(ConfigKeywords) / sizeof(CONFIG_KEYWORD))
+#define KEYWORD_HASH_SIZE   (64) /* must be a power of 2 and more than NUM_CONFIG_KEYWORDS */
+// Starting value for HashKeyword(), chosen (by trying values in turn) so that no
+// two of the keywords above share a slot in KeywordHash; that is, so that the
+// hash is perfect. If a keyword is added, lookups still work, since collisions
+// are resolved by probing, but a new seed should be found.
+#define KEYWORD_HASH_SEED   (0x811cda34U)
+
+// Hash table of indexes into ConfigKeywords, plus one; 0 marks an empty slot
+static UINT8 KeywordHash[KEYWORD_HASH_SIZE];
+static BOOLEAN KeywordHashReady = FALSE;
+
+// Linux kernel options, by volume and directory; see GetLinuxOptions()
+static LINUX_OPTIONS **LinuxOptionsCache = NULL;
+static UINTN         LinuxOptionsCacheCount = 0;
+
+// Tokenized configuration files; see ReadConfigFile()
+static CONFIG_CACHE  *ConfigCache = NULL;
+
 //
 // read a file into a buffer
 //
 
+// Read FileName into File->Buffer, converting it to UTF-16 along the way, so
+// that ReadLine() and ReadTokenLine() can work in place on the buffer. The
+// buffer always holds one CHAR16 more than the text itself, so that the last
+// line can be NUL-terminated even if the file doesn't end in a newline.
+// *size is set to the size of the file on disk.
 EFI_STATUS ReadFile(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN OUT REFIT_FILE *File, OUT UINTN *size)
 {
     EFI_STATUS      Status;
     EFI_FILE_HANDLE FileHandle;
     EFI_FILE_INFO   *FileInfo;
     UINT64          ReadSize;
+    UINT8           *RawBuffer, *RawStart;
+    UINTN           RawSize, TextLength;
+    BOOLEAN         IsUtf8;
+    CHAR16          *Text;
     CHAR16          Message[256];
 
     File->Buffer = NULL;
     File->BufferSize = 0;
+    File->TokenList = NULL;
+    File->TokenListSize = 0;
+    File->Cache = NULL;
+    File->CacheLine = 0;
 
     // read the file, allocating a buffer on the way
     Status = refit_call5_wrapper(BaseDir->Open, BaseDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
@@ -94,126 +207,117 @@ EFI_STATUS ReadFile(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN OUT REFI
         return EFI_LOAD_ERROR;
     }
     ReadSize = FileInfo->FileSize;
+    File->ModificationTime = FileInfo->ModificationTime;
     FreePool(FileInfo);
 
-    File->BufferSize = (UINTN)ReadSize;
-    File->Buffer = AllocatePool(File->BufferSize);
-    if (File->Buffer == NULL) {
-       size = 0;
+    RawSize = (UINTN)ReadSize;
+    RawBuffer = AllocatePool(RawSize + sizeof(CHAR16));
+    if (RawBuffer == NULL) {
+       *size = 0;
+       refit_call1_wrapper(FileHandle->Close, FileHandle);
        return EFI_OUT_OF_RESOURCES;
     } else {
-       *size = File->BufferSize;
+       *size = RawSize;
     } // if/else
-    Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &File->BufferSize, File->Buffer);
+    Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &RawSize, RawBuffer);
     if (CheckError(Status, Message)) {
-        MyFreePool(File->Buffer);
-        File->Buffer = NULL;
+        MyFreePool(RawBuffer);
         refit_call1_wrapper(FileHandle->Close, FileHandle);
         return Status;
     }
     Status = refit_call1_wrapper(FileHandle->Close, FileHandle);
 
-    // setup for reading
-    File->Current8Ptr  = (CHAR8 *)File->Buffer;
-    File->End8Ptr      = File->Current8Ptr + File->BufferSize;
-    File->Current16Ptr = (CHAR16 *)File->Buffer;
-    File->End16Ptr     = File->Current16Ptr + (File->BufferSize >> 1);
-
     // detect encoding
-    File->Encoding = ENCODING_ISO8859_1;   // default: 1:1 translation of CHAR8 to CHAR16
-    if (File->BufferSize >= 4) {
-        if (File->Buffer[0] == 0xFF && File->Buffer[1] == 0xFE) {
+    File->Encoding = ENCODING_ISO8859_1;   // default: UTF-8 if valid, else 1:1 CHAR8 to CHAR16
+    RawStart = RawBuffer;
+    if (RawSize >= 4) {
+        if (RawBuffer[0] == 0xFF && RawBuffer[1] == 0xFE) {
             // BOM in UTF-16 little endian (or UTF-32 little endian)
             File->Encoding = ENCODING_UTF16_LE;   // use CHAR16 as is
-            File->Current16Ptr++;
-        } else if (File->Buffer[0] == 0xEF && File->Buffer[1] == 0xBB && File->Buffer[2] == 0xBF) {
+            RawStart += 2;
+        } else if (RawBuffer[0] == 0xEF && RawBuffer[1] == 0xBB && RawBuffer[2] == 0xBF) {
             // BOM in UTF-8
             File->Encoding = ENCODING_UTF8;       // translate from UTF-8 to UTF-16
-            File->Current8Ptr += 3;
-        } else if (File->Buffer[1] == 0 && File->Buffer[3] == 0) {
+            RawStart += 3;
+        } else if (RawBuffer[1] == 0 && RawBuffer[3] == 0) {
             File->Encoding = ENCODING_UTF16_LE;   // use CHAR16 as is
         }
         // TODO: detect other encodings as they are implemented
     }
+    RawSize -= (UINTN)(RawStart - RawBuffer);
+
+    if (File->Encoding == ENCODING_UTF16_LE) {
+        // UTF-16 text can be used where it lies
+        File->Buffer = RawBuffer;
+        File->BufferSize = RawSize & ~((UINTN) 1);
+        Text = (CHAR16 *)RawStart;
+    } else {
+        Text = AllocatePool((RawSize + 1) * sizeof(CHAR16));
+        if (Text == NULL) {
+            MyFreePool(RawBuffer);
+            return EFI_OUT_OF_RESOURCES;
+        }
+        // Files without a BOM are treated as UTF-8 unless they contain
+        // something that isn't valid UTF-8, in which case they're assumed
+        // to be ISO-8859-1, as in earlier versions of rEFInd.
+        TextLength = Utf8ToUtf16(RawStart, RawSize, Text, &IsUtf8);
+        if ((File->Encoding == ENCODING_ISO8859_1) && !IsUtf8) {
+            for (TextLength = 0; TextLength < RawSize; TextLength++)
+                Text[TextLength] = RawStart[TextLength];
+        }
+        MyFreePool(RawBuffer);
+        File->Buffer = (UINT8 *)Text;
+        File->BufferSize = TextLength * sizeof(CHAR16);
+        File->Encoding = ENCODING_UTF16_LE;
+    } // if/else
+
+    // setup for reading
+    File->Current16Ptr = Text;
+    File->End16Ptr     = Text + (File->BufferSize >> 1);
 
     return EFI_SUCCESS;
 }
 
+// Free the memory associated with File (but not File itself)
+VOID FreeRefitFile(IN OUT REFIT_FILE *File)
+{
+    if (File != NULL) {
+        MyFreePool(File->Buffer);
+        File->Buffer = NULL;
+        MyFreePool(File->TokenList);
+        File->TokenList = NULL;
+        File->TokenListSize = 0;
+        File->Cache = NULL;   // the cache itself is kept
+    }
+} // VOID FreeRefitFile()
+
 //
 // get a single line of text from a file
 //
 
+// Returns the next line of the file, with its end-of-line characters replaced
+// by a NUL. The line is not a copy; it points into File->Buffer.
 static CHAR16 *ReadLine(REFIT_FILE *File)
 {
-    CHAR16  *Line, *q;
-    UINTN   LineLength;
+    CHAR16  *Line, *LineEnd, *p;
 
-    if (File->Buffer == NULL)
+    if ((File->Buffer == NULL) || (File->Encoding != ENCODING_UTF16_LE))
         return NULL;
 
-    if (File->Encoding == ENCODING_ISO8859_1 || File->Encoding == ENCODING_UTF8) {
-
-        CHAR8 *p, *LineStart, *LineEnd;
-
-        p = File->Current8Ptr;
-        if (p >= File->End8Ptr)
-            return NULL;
-
-        LineStart = p;
-        for (; p < File->End8Ptr; p++)
-            if (*p == 13 || *p == 10)
-                break;
-        LineEnd = p;
-        for (; p < File->End8Ptr; p++)
-            if (*p != 13 && *p != 10)
-                break;
-        File->Current8Ptr = p;
-
-        LineLength = (UINTN)(LineEnd - LineStart) + 1;
-        Line = AllocatePool(LineLength * sizeof(CHAR16));
-        if (Line == NULL)
-            return NULL;
-
-        q = Line;
-        if (File->Encoding == ENCODING_ISO8859_1) {
-            for (p = LineStart; p < LineEnd; )
-                *q++ = *p++;
-        } else if (File->Encoding == ENCODING_UTF8) {
-            // TODO: actually handle UTF-8
-            for (p = LineStart; p < LineEnd; )
-                *q++ = *p++;
-        }
-        *q = 0;
-
-    } else if (File->Encoding == ENCODING_UTF16_LE) {
-
-        CHAR16 *p, *LineStart, *LineEnd;
-
-        p = File->Current16Ptr;
-        if (p >= File->End16Ptr)
-            return NULL;
-
-        LineStart = p;
-        for (; p < File->End16Ptr; p++)
-            if (*p == 13 || *p == 10)
-                break;
-        LineEnd = p;
-        for (; p < File->End16Ptr; p++)
-            if (*p != 13 && *p != 10)
-                break;
-        File->Current16Ptr = p;
-
-        LineLength = (UINTN)(LineEnd - LineStart) + 1;
-        Line = AllocatePool(LineLength * sizeof(CHAR16));
-        if (Line == NULL)
-            return NULL;
-
-        for (p = LineStart, q = Line; p < LineEnd; )
-            *q++ = *p++;
-        *q = 0;
+    p = File->Current16Ptr;
+    if (p >= File->End16Ptr)
+        return NULL;
 
-    } else
-        return NULL;   // unsupported encoding
+    Line = p;
+    for (; p < File->End16Ptr; p++)
+        if (*p == 13 || *p == 10)
+            break;
+    LineEnd = p;
+    for (; p < File->End16Ptr; p++)
+        if (*p != 13 && *p != 10)
+            break;
+    File->Current16Ptr = p;
+    *LineEnd = 0;
 
     return Line;
 }
@@ -223,7 +327,7 @@ static CHAR16 *ReadLine(REFIT_FILE *File)
 // quotes ('"'); it deletes one of them.
 static BOOLEAN KeepReading(IN OUT CHAR16 *p, IN OUT BOOLEAN *IsQuoted) {
    BOOLEAN MoreToRead = FALSE;
-   CHAR16  *Temp = NULL;
+   CHAR16  *q;
 
    if ((p == NULL) || (IsQuoted == NULL))
       return FALSE;
@@ -236,11 +340,8 @@ static BOOLEAN KeepReading(IN OUT CHAR16 *p, IN OUT BOOLEAN *IsQuoted) {
    }
    if (*p == L'"') {
       if (p[1] == L'"') {
-         Temp = StrDuplicate(&p[1]);
-         if (Temp != NULL) {
-            StrCpy(p, Temp);
-            FreePool(Temp);
-         }
+         for (q = p; *q != L'\0'; q++)
+            q[0] = q[1];
          MoreToRead = TRUE;
       } else {
          *IsQuoted = !(*IsQuoted);
@@ -251,9 +352,35 @@ static BOOLEAN KeepReading(IN OUT CHAR16 *p, IN OUT BOOLEAN *IsQuoted) {
    return MoreToRead;
 } // BOOLEAN KeepReading()
 
+// Store Token as entry number TokenCount in File's token list, enlarging
+// the list if necessary. The list is kept between calls to ReadTokenLine(),
+// so this allocates memory only for the longest lines in a file.
+static BOOLEAN StoreToken(IN OUT REFIT_FILE *File, IN UINTN TokenCount, IN CHAR16 *Token) {
+   CHAR16 **NewList;
+
+   if (TokenCount >= File->TokenListSize) {
+      NewList = AllocatePool((File->TokenListSize + TOKEN_LIST_INCREMENT) * sizeof(CHAR16 *));
+      if (NewList == NULL)
+         return FALSE;
+      if (File->TokenList != NULL) {
+         CopyMem(NewList, File->TokenList, TokenCount * sizeof(CHAR16 *));
+         FreePool(File->TokenList);
+      }
+      File->TokenList = NewList;
+      File->TokenListSize += TOKEN_LIST_INCREMENT;
+   } // if
+   File->TokenList[TokenCount] = Token;
+   return TRUE;
+} // static BOOLEAN StoreToken()
+
 //
 // get a line of tokens from a file
 //
+// The tokens are NUL-terminated in place in File->Buffer and remain valid
+// until the file is freed; but *TokenList itself belongs to File and is
+// overwritten by the next call to ReadTokenLine() for the same file. For a
+// file opened by ReadConfigFile(), both belong to the configuration cache.
+//
 UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList)
 {
     BOOLEAN         LineFinished, IsQuoted = FALSE;
@@ -262,6 +389,15 @@ UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList)
 
     *TokenList = NULL;
 
+    if (File->Cache != NULL) {
+        if (File->CacheLine >= File->Cache->LineCount)
+            return(0);
+        *TokenList = File->Cache->Tokens + File->Cache->LineStarts[File->CacheLine];
+        TokenCount = File->Cache->LineStarts[File->CacheLine + 1] - File->Cache->LineStarts[File->CacheLine];
+        File->CacheLine++;
+        return (TokenCount);
+    } // if
+
     while (TokenCount == 0) {
         Line = ReadLine(File);
         if (Line == NULL)
@@ -292,20 +428,130 @@ UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList)
                 LineFinished = TRUE;
             *p++ = 0;
 
-            AddListElement((VOID ***)TokenList, &TokenCount, (VOID *)StrDuplicate(Token));
+            if (!StoreToken(File, TokenCount, Token))
+                return(0);
+            TokenCount++;
         }
-
-        FreePool(Line);
     }
+    *TokenList = File->TokenList;
     return (TokenCount);
 } /* ReadTokenLine() */
 
+// The tokens and the list that holds them both belong to the REFIT_FILE
+// from which they were read, so there's nothing to free here.
 VOID FreeTokenLine(IN OUT CHAR16 ***TokenList, IN OUT UINTN *TokenCount)
 {
-    // TODO: also free the items
-    FreeList((VOID ***)TokenList, TokenCount);
+    *TokenList = NULL;
 }
 
+static VOID FreeConfigCache(IN CONFIG_CACHE *Cache) {
+   MyFreePool(Cache->FileName);
+   MyFreePool(Cache->Text);
+   MyFreePool(Cache->Tokens);
+   MyFreePool(Cache->LineStarts);
+   FreePool(Cache);
+} // static VOID FreeConfigCache()
+
+// Make room for at least Count elements of ElementSize bytes each in *List,
+// which has room for *Allocated of them, by doubling its size as needed.
+static BOOLEAN GrowArray(IN OUT VOID **List, IN OUT UINTN *Allocated, IN UINTN Count, IN UINTN ElementSize) {
+   UINTN NewSize;
+   VOID  *NewList;
+
+   if (Count <= *Allocated)
+      return TRUE;
+   NewSize = (*Allocated > 0) ? (*Allocated * 2) : 64;
+   while (NewSize < Count)
+      NewSize *= 2;
+   NewList = AllocatePool(NewSize * ElementSize);
+   if (NewList == NULL)
+      return FALSE;
+   if (*List != NULL) {
+      CopyMem(NewList, *List, *Allocated * ElementSize);
+      FreePool(*List);
+   }
+   *List = NewList;
+   *Allocated = NewSize;
+   return TRUE;
+} // static BOOLEAN GrowArray()
+
+// Tokenize all of File, which has just been read by ReadFile(), into a new
+// cache entry, which takes over File->Buffer. Returns NULL if memory runs out.
+static CONFIG_CACHE * TokenizeConfigFile(IN OUT REFIT_FILE *File, IN CHAR16 *FileName, IN UINTN Size, IN UINT32 Crc) {
+   CONFIG_CACHE  *Cache;
+   CHAR16        **TokenList;
+   UINTN         TokenCount, TokensAllocated = 0, LinesAllocated = 0, TotalTokens = 0;
+
+   Cache = AllocateZeroPool(sizeof(CONFIG_CACHE));
+   if (Cache == NULL)
+      return NULL;
+   Cache->FileName = StrDuplicate(FileName);
+   Cache->FileSize = Size;
+   Cache->ModificationTime = File->ModificationTime;
+   Cache->Crc = Crc;
+
+   do {
+      TokenCount = ReadTokenLine(File, &TokenList);
+      if (!GrowArray((VOID **) &(Cache->LineStarts), &LinesAllocated, Cache->LineCount + 1, sizeof(UINTN)) ||
+          !GrowArray((VOID **) &(Cache->Tokens), &TokensAllocated, TotalTokens + TokenCount, sizeof(CHAR16 *))) {
+         FreeConfigCache(Cache);
+         return NULL;
+      }
+      Cache->LineStarts[Cache->LineCount] = TotalTokens;
+      if (TokenCount > 0) {
+         CopyMem(Cache->Tokens + TotalTokens, TokenList, TokenCount * sizeof(CHAR16 *));
+         TotalTokens += TokenCount;
+         Cache->LineCount++;
+      }
+   } while (TokenCount > 0);
+
+   Cache->Text = File->Buffer;
+   File->Buffer = NULL;
+   return Cache;
+} // static CONFIG_CACHE * TokenizeConfigFile()
+
+// Open FileName, in rEFInd's own directory, for ReadTokenLine(). A file that's
+// unchanged since it was last read isn't tokenized again; its lines are
+// returned from ConfigCache instead. The file is still read each time, since
+// it's judged unchanged only if its size, modification time, and CRC all match
+// (the firmware's clock and FAT time stamps are too coarse to trust alone).
+// Since the tokens are shared with later reads, callers may change them only
+// in ways that give the same result when repeated, as HandleStrings() does.
+static EFI_STATUS ReadConfigFile(IN CHAR16 *FileName, OUT REFIT_FILE *File) {
+   EFI_STATUS    Status;
+   CONFIG_CACHE  *Cache, **Link;
+   UINTN         Size;
+   UINT32        Crc;
+
+   Status = ReadFile(SelfDir, FileName, File, &Size);
+   if (EFI_ERROR(Status))
+      return Status;
+   Crc = crc32(0x0, File->Buffer, File->BufferSize);
+
+   for (Link = &ConfigCache; *Link != NULL; Link = &((*Link)->NextEntry)) {
+      if (StriCmp((*Link)->FileName, FileName) == 0)
+         break;
+   } // for
+   Cache = *Link;
+   if ((Cache == NULL) || (Cache->FileSize != Size) || (Cache->Crc != Crc) ||
+       (CompareMem(&(Cache->ModificationTime), &(File->ModificationTime), sizeof(EFI_TIME)) != 0)) {
+      Cache = TokenizeConfigFile(File, FileName, Size, Crc);
+      if (Cache == NULL) {
+         FreeRefitFile(File);
+         return EFI_OUT_OF_RESOURCES;
+      }
+      if (*Link != NULL) {
+         Cache->NextEntry = (*Link)->NextEntry;
+         FreeConfigCache(*Link);
+      }
+      *Link = Cache;
+   } // if file changed
+   FreeRefitFile(File);
+   File->Cache = Cache;
+   File->CacheLine = 0;
+   return EFI_SUCCESS;
+} // static EFI_STATUS ReadConfigFile()
+
 // handle a parameter with a single integer argument
 static VOID HandleInt(IN CHAR16 **TokenList, IN UINTN TokenCount, OUT UINTN *Value)
 {
@@ -431,6 +677,45 @@ static VOID SetDefaultByTime(IN CHAR16 **TokenList, OUT CHAR16 **Default) {
    } // if ((StartTime <= LAST_MINUTE) && (EndTime <= LAST_MINUTE))
 } // VOID SetDefaultByTime()
 
+// Case-insensitive (for ASCII letters) hash of a keyword
+static UINTN HashKeyword(IN CHAR16 *Word) {
+   UINT32 Hash = KEYWORD_HASH_SEED;
+   CHAR16 c;
+
+   while ((c = *Word++) != L'\0') {
+      if ((c >= L'A') && (c <= L'Z'))
+         c += L'a' - L'A';
+      Hash = (Hash ^ c) * 16777619U;
+   }
+   return (UINTN) (Hash ^ (Hash >> 16)) & (KEYWORD_HASH_SIZE - 1);
+} // static UINTN HashKeyword()
+
+// Identify a configuration file keyword, returning its KW_* code, or KW_UNKNOWN
+// if Word isn't a keyword. This replaces a long chain of string comparisons,
+// one for each possible keyword, for every line of the configuration file.
+static UINTN ConfigKeyword(IN CHAR16 *Word) {
+   UINTN Slot, i;
+
+   if (!KeywordHashReady) {
+      for (i = 0; i < NUM_CONFIG_KEYWORDS; i++) {
+         Slot = HashKeyword(ConfigKeywords[i].Name);
+         while (KeywordHash[Slot] != 0)
+            Slot = (Slot + 1) & (KEYWORD_HASH_SIZE - 1);
+         KeywordHash[Slot] = (UINT8) (i + 1);
+      } // for
+      KeywordHashReady = TRUE;
+   } // if
+
+   Slot = HashKeyword(Word);
+   while (KeywordHash[Slot] != 0) {
+      i = KeywordHash[Slot] - 1;
+      if (StriCmp(Word, ConfigKeywords[i].Name) == 0)
+         return ConfigKeywords[i].Id;
+      Slot = (Slot + 1) & (KEYWORD_HASH_SIZE - 1);
+   } // while
+   return KW_UNKNOWN;
+} // static UINTN ConfigKeyword()
+
 // read config file
 VOID ReadConfig(CHAR16 *FileName)
 {
@@ -439,7 +724,7 @@ VOID ReadConfig(CHAR16 *FileName)
     CHAR16          **TokenList;
     CHAR16          *FlagName;
     CHAR16          *TempStr = NULL;
-    UINTN           TokenCount, i;
+    UINTN           TokenCount, Keyword, i;
     EFI_GUID        RefindGuid = REFIND_GUID_VALUE;
 
     // Set a few defaults only if we're loading the default file.
@@ -479,7 +764,7 @@ VOID ReadConfig(CHAR16 *FileName)
         return;
     }
 
-    Status = ReadFile(SelfDir, FileName, &File, &i);
+    Status = ReadConfigFile(FileName, &File);
     if (EFI_ERROR(Status))
         return;
 
@@ -488,10 +773,11 @@ VOID ReadConfig(CHAR16 *FileName)
         if (TokenCount == 0)
             break;
 
-        if (StriCmp(TokenList[0], L"timeout") == 0) {
+        Keyword = ConfigKeyword(TokenList[0]);
+        if (Keyword == KW_TIMEOUT) {
             HandleInt(TokenList, TokenCount, &(GlobalConfig.Timeout));
 
-        } else if (StriCmp(TokenList[0], L"hideui") == 0) {
+        } else if (Keyword == KW_HIDEUI) {
             for (i = 1; i < TokenCount; i++) {
                 FlagName = TokenList[i];
                 if (StriCmp(FlagName, L"banner") == 0) {
@@ -517,10 +803,10 @@ VOID ReadConfig(CHAR16 *FileName)
                 }
             }
 
-        } else if (StriCmp(TokenList[0], L"icons_dir") == 0) {
+        } else if (Keyword == KW_ICONS_DIR) {
            HandleString(TokenList, TokenCount, &(GlobalConfig.IconsDir));
 
-        } else if (StriCmp(TokenList[0], L"scanfor") == 0) {
+        } else if (Keyword == KW_SCANFOR) {
            for (i = 0; i < NUM_SCAN_OPTIONS; i++) {
               if (i < TokenCount)
                  GlobalConfig.ScanFor[i] = TokenList[i][0];
@@ -528,16 +814,22 @@ VOID ReadConfig(CHAR16 *FileName)
                  GlobalConfig.ScanFor[i] = ' ';
            }
 
-        } else if (StriCmp(TokenList[0], L"uefi_deep_legacy_scan") == 0) {
+        } else if (Keyword == KW_UEFI_DEEP_LEGACY_SCAN) {
            GlobalConfig.DeepLegacyScan = HandleBoolean(TokenList, TokenCount);
 
-        } else if ((StriCmp(TokenList[0], L"scan_delay") == 0) && (TokenCount == 2)) {
+        } else if (Keyword == KW_USE_LINEAR_FRAMEBUFFER) {
+           GlobalConfig.UseLinearFramebuffer = HandleBoolean(TokenList, TokenCount);
+
+        } else if (Keyword == KW_TARGETED_DRIVER_CONNECT) {
+           GlobalConfig.TargetedDriverConnect = HandleBoolean(TokenList, TokenCount);
+
+        } else if ((Keyword == KW_SCAN_DELAY) && (TokenCount == 2)) {
            HandleInt(TokenList, TokenCount, &(GlobalConfig.ScanDelay));
 
-        } else if (StriCmp(TokenList[0], L"also_scan_dirs") == 0) {
+        } else if (Keyword == KW_ALSO_SCAN_DIRS) {
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.AlsoScan));
 
-        } else if ((StriCmp(TokenList[0], L"don't_scan_volumes") == 0) || (StriCmp(TokenList[0], L"dont_scan_volumes") == 0)) {
+        } else if (Keyword == KW_DONT_SCAN_VOLUMES) {
            // Note: Don't use HandleStrings() because it modifies slashes, which might be present in volume name
            MyFreePool(GlobalConfig.DontScanVolumes);
            GlobalConfig.DontScanVolumes = NULL;
@@ -545,19 +837,19 @@ VOID ReadConfig(CHAR16 *FileName)
               MergeStrings(&GlobalConfig.DontScanVolumes, TokenList[i], L',');
            }
 
-        } else if ((StriCmp(TokenList[0], L"don't_scan_dirs") == 0) || (StriCmp(TokenList[0], L"dont_scan_dirs") == 0)) {
+        } else if (Keyword == KW_DONT_SCAN_DIRS) {
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.DontScanDirs));
 
-        } else if ((StriCmp(TokenList[0], L"don't_scan_files") == 0) || (StriCmp(TokenList[0], L"dont_scan_files") == 0)) {
+        } else if (Keyword == KW_DONT_SCAN_FILES) {
            HandleStrings(TokenList, TokenCount, &(GlobalConfig.DontScanFiles));
 
-        } else if (StriCmp(TokenList[0], L"windows_recovery_files") == 0) {
+        } else if (Keyword == KW_WINDOWS_RECOVERY_FILES) {
            HandleStrings(TokenList, TokenCount, &(GlobalConfig.WindowsRecoveryFiles));
 
-        } else if (StriCmp(TokenList[0], L"scan_driver_dirs") == 0) {
+        } else if (Keyword == KW_SCAN_DRIVER_DIRS) {
             HandleStrings(TokenList, TokenCount, &(GlobalConfig.DriverDirs));
 
-        } else if (StriCmp(TokenList[0], L"showtools") == 0) {
+        } else if (Keyword == KW_SHOWTOOLS) {
             SetMem(GlobalConfig.ShowTools, NUM_TOOLS * sizeof(UINTN), 0);
             for (i = 1; (i < TokenCount) && (i < NUM_TOOLS); i++) {
                 FlagName = TokenList[i];
@@ -590,10 +882,10 @@ VOID ReadConfig(CHAR16 *FileName)
                 }
             } // showtools options
 
-        } else if (StriCmp(TokenList[0], L"banner") == 0) {
+        } else if (Keyword == KW_BANNER) {
            HandleString(TokenList, TokenCount, &(GlobalConfig.BannerFileName));
 
-        } else if ((StriCmp(TokenList[0], L"banner_scale") == 0) && (TokenCount == 2)) {
+        } else if ((Keyword == KW_BANNER_SCALE) && (TokenCount == 2)) {
            if (StriCmp(TokenList[1], L"noscale") == 0) {
               GlobalConfig.BannerScale = BANNER_NOSCALE;
            } else if ((StriCmp(TokenList[1], L"fillscreen") == 0) || (StriCmp(TokenList[1], L"fullscreen") == 0)) {
@@ -602,48 +894,57 @@ VOID ReadConfig(CHAR16 *FileName)
               Print(L" unknown banner_type flag: '%s'\n", TokenList[1]);
            } // if/else
 
-        } else if ((StriCmp(TokenList[0], L"small_icon_size") == 0) && (TokenCount == 2)) {
+        } else if ((Keyword == KW_SORT_BY) && (TokenCount == 2)) {
+           if (StriCmp(TokenList[1], L"date") == 0) {
+              GlobalConfig.SortBy = SORT_BY_DATE;
+           } else if (StriCmp(TokenList[1], L"version") == 0) {
+              GlobalConfig.SortBy = SORT_BY_VERSION;
+           } else {
+              Print(L" unknown sort_by flag: '%s'\n", TokenList[1]);
+           } // if/else
+
+        } else if ((Keyword == KW_SMALL_ICON_SIZE) && (TokenCount == 2)) {
            HandleInt(TokenList, TokenCount, &i);
            if (i >= 32)
               GlobalConfig.IconSizes[ICON_SIZE_SMALL] = i;
 
-        } else if ((StriCmp(TokenList[0], L"big_icon_size") == 0) && (TokenCount == 2)) {
+        } else if ((Keyword == KW_BIG_ICON_SIZE) && (TokenCount == 2)) {
            HandleInt(TokenList, TokenCount, &i);
            if (i >= 32) {
               GlobalConfig.IconSizes[ICON_SIZE_BIG] = i;
               GlobalConfig.IconSizes[ICON_SIZE_BADGE] = i / 4;
            }
 
-        } else if (StriCmp(TokenList[0], L"selection_small") == 0) {
+        } else if (Keyword == KW_SELECTION_SMALL) {
            HandleString(TokenList, TokenCount, &(GlobalConfig.SelectionSmallFileName));
 
-        } else if (StriCmp(TokenList[0], L"selection_big") == 0) {
+        } else if (Keyword == KW_SELECTION_BIG) {
            HandleString(TokenList, TokenCount, &(GlobalConfig.SelectionBigFileName));
 
-        } else if (StriCmp(TokenList[0], L"default_selection") == 0) {
+        } else if (Keyword == KW_DEFAULT_SELECTION) {
            if (TokenCount == 4) {
               SetDefaultByTime(TokenList, &(GlobalConfig.DefaultSelection));
            } else {
               HandleString(TokenList, TokenCount, &(GlobalConfig.DefaultSelection));
            }
 
-        } else if (StriCmp(TokenList[0], L"textonly") == 0) {
+        } else if (Keyword == KW_TEXTONLY) {
            GlobalConfig.TextOnly = HandleBoolean(TokenList, TokenCount);
 
-        } else if (StriCmp(TokenList[0], L"textmode") == 0) {
+        } else if (Keyword == KW_TEXTMODE) {
            HandleInt(TokenList, TokenCount, &(GlobalConfig.RequestedTextMode));
 
-        } else if ((StriCmp(TokenList[0], L"resolution") == 0) && ((TokenCount == 2) || (TokenCount == 3))) {
+        } else if ((Keyword == KW_RESOLUTION) && ((TokenCount == 2) || (TokenCount == 3))) {
            GlobalConfig.RequestedScreenWidth = Atoi(TokenList[1]);
            if (TokenCount == 3)
               GlobalConfig.RequestedScreenHeight = Atoi(TokenList[2]);
            else
               GlobalConfig.RequestedScreenHeight = 0;
 
-        } else if (StriCmp(TokenList[0], L"screensaver") == 0) {
+        } else if (Keyword == KW_SCREENSAVER) {
            HandleInt(TokenList, TokenCount, &(GlobalConfig.ScreensaverTime));
 
-        } else if (StriCmp(TokenList[0], L"use_graphics_for") == 0) {
+        } else if (Keyword == KW_USE_GRAPHICS_FOR) {
            if ((TokenCount == 2) || ((TokenCount > 2) && (StriCmp(TokenList[1], L"+") != 0)))
               GlobalConfig.GraphicsFor = 0;
            for (i = 1; i < TokenCount; i++) {
@@ -660,16 +961,16 @@ VOID ReadConfig(CHAR16 *FileName)
               }
            } // for (graphics_on tokens)
 
-        } else if ((StriCmp(TokenList[0], L"font") == 0) && (TokenCount == 2)) {
+        } else if ((Keyword == KW_FONT) && (TokenCount == 2)) {
            egLoadFont(TokenList[1]);
 
-        } else if (StriCmp(TokenList[0], L"scan_all_linux_kernels") == 0) {
+        } else if (Keyword == KW_SCAN_ALL_LINUX_KERNELS) {
            GlobalConfig.ScanAllLinux = HandleBoolean(TokenList, TokenCount);
 
-        } else if (StriCmp(TokenList[0], L"max_tags") == 0) {
+        } else if (Keyword == KW_MAX_TAGS) {
            HandleInt(TokenList, TokenCount, &(GlobalConfig.MaxTags));
 
-        } else if ((StriCmp(TokenList[0], L"include") == 0) && (TokenCount == 2) &&
+        } else if ((Keyword == KW_INCLUDE) && (TokenCount == 2) &&
                    (StriCmp(FileName, GlobalConfig.ConfigFilename) == 0)) {
            if (StriCmp(TokenList[1], FileName) != 0) {
               ReadConfig(TokenList[1]);
@@ -681,7 +982,7 @@ VOID ReadConfig(CHAR16 *FileName)
     }
     if ((GlobalConfig.DontScanFiles) && (GlobalConfig.WindowsRecoveryFiles))
        MergeStrings(&(GlobalConfig.DontScanFiles), GlobalConfig.WindowsRecoveryFiles, L',');
-    MyFreePool(File.Buffer);
+    FreeRefitFile(&File);
 } /* VOID ReadConfig() */
 
 // Finds a volume with the specified Identifier (a filesystem label, a
@@ -758,6 +1059,7 @@ static VOID AddSubmenu(LOADER_ENTRY *Entry, REFIT_FILE *File, REFIT_VOLUME *Volu
             SPrint(SubEntry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", Volume->VolName);
             SubEntry->me.BadgeImage   = Volume->VolBadgeImage;
             SubEntry->VolName         = Volume->VolName;
+            SubEntry->Volume          = Volume;
          } // if match found
 
       } else if (StriCmp(TokenList[0], L"initrd") == 0) {
@@ -820,6 +1122,7 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
    Entry->me.Row          = 0;
    Entry->me.BadgeImage   = CurrentVolume->VolBadgeImage;
    Entry->VolName         = CurrentVolume->VolName;
+   Entry->Volume          = CurrentVolume;
 
    // Parse the config file to add options for a single stanza, terminating when the token
    // is "}" or when the end of file is reached.
@@ -839,6 +1142,7 @@ static LOADER_ENTRY * AddStanzaEntries(REFIT_FILE *File, REFIT_VOLUME *Volume, C
             SPrint(Entry->me.Title, 255, L"Boot %s from %s", (Title != NULL) ? Title : L"Unknown", CurrentVolume->VolName);
             Entry->me.BadgeImage   = CurrentVolume->VolBadgeImage;
             Entry->VolName         = CurrentVolume->VolName;
+            Entry->Volume          = CurrentVolume;
          } // if match found
 
       } else if ((StriCmp(TokenList[0], L"icon") == 0) && (TokenCount > 1)) {
@@ -900,11 +1204,11 @@ VOID ScanUserConfigured(CHAR16 *FileName)
    REFIT_VOLUME      *Volume;
    CHAR16            **TokenList;
    CHAR16            *Title = NULL;
-   UINTN             TokenCount, size;
+   UINTN             TokenCount;
    LOADER_ENTRY      *Entry;
 
    if (FileExists(SelfDir, FileName)) {
-      Status = ReadFile(SelfDir, FileName, &File, &size);
+      Status = ReadConfigFile(FileName, &File);
       if (EFI_ERROR(Status))
          return;
 
@@ -932,6 +1236,7 @@ VOID ScanUserConfigured(CHAR16 *FileName)
          } // if/else if...
          FreeTokenLine(&TokenList, &TokenCount);
       } // while()
+      FreeRefitFile(&File);
    } // if()
 } // VOID ScanUserConfigured()
 
@@ -981,12 +1286,10 @@ static REFIT_FILE * GenerateOptionsFromEtcFstab(REFIT_VOLUME *Volume) {
             FreeTokenLine(&TokenList, &TokenCount);
          } // while
 
-         Options->Current8Ptr  = (CHAR8 *)Options->Buffer;
-         Options->End8Ptr      = Options->Current8Ptr + Options->BufferSize;
          Options->Current16Ptr = (CHAR16 *)Options->Buffer;
          Options->End16Ptr     = Options->Current16Ptr + (Options->BufferSize >> 1);
 
-         MyFreePool(Fstab->Buffer);
+         FreeRefitFile(Fstab);
          MyFreePool(Fstab);
       } // if/else file read error
    } // if /etc/fstab exists
@@ -1010,7 +1313,7 @@ static REFIT_FILE * GenerateOptionsFromEtcFstab(REFIT_VOLUME *Volume) {
 //
 // The return value is a pointer to the REFIT_FILE handle for the file, or NULL if
 // it wasn't found.
-REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
+static REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
    CHAR16       *OptionsFilename, *FullFilename;
    BOOLEAN      GoOn = TRUE, FileFound = FALSE;
    UINTN        i = 0, size;
@@ -1037,30 +1340,94 @@ REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume
       } else { // a filename string is NULL
          GoOn = FALSE;
       } // if/else
-      if (!FileFound)
-         File = GenerateOptionsFromEtcFstab(Volume);
       MyFreePool(OptionsFilename);
       MyFreePool(FullFilename);
       OptionsFilename = FullFilename = NULL;
    } while (GoOn);
+   if (!FileFound)
+      File = GenerateOptionsFromEtcFstab(Volume);
    return (File);
 } // static REFIT_FILE * ReadLinuxOptionsFile()
 
-// Retrieve a single line of options from a Linux kernel options file
-CHAR16 * GetFirstOptionsFromFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
-   UINTN        TokenCount;
-   CHAR16       *Options = NULL;
-   CHAR16       **TokenList;
-   REFIT_FILE   *File;
+// Return the Linux kernel options that apply to LoaderPath on Volume, or NULL if
+// there are none. Every kernel in a directory shares the same options file, so
+// the parsed results are kept, per volume and directory, until
+// FreeLinuxOptionsCache() is called. The caller must not free the result.
+LINUX_OPTIONS * GetLinuxOptions(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
+   CHAR16         *Directory, **TokenList;
+   UINTN          i, TokenCount;
+   LINUX_OPTIONS  *LinuxOptions;
+   REFIT_FILE     *File;
+
+   if ((LoaderPath == NULL) || (Volume == NULL))
+      return NULL;
+   Directory = FindPath(LoaderPath);
+   if (Directory == NULL)
+      return NULL;
+
+   for (i = 0; i < LinuxOptionsCacheCount; i++) {
+      LinuxOptions = LinuxOptionsCache[i];
+      if ((LinuxOptions->Volume == Volume) && (StriCmp(LinuxOptions->Directory, Directory) == 0)) {
+         MyFreePool(Directory);
+         return (LinuxOptions->LineCount > 0) ? LinuxOptions : NULL;
+      } // if
+   } // for
+
+   LinuxOptions = AllocateZeroPool(sizeof(LINUX_OPTIONS));
+   if (LinuxOptions == NULL) {
+      MyFreePool(Directory);
+      return NULL;
+   }
+   LinuxOptions->Volume = Volume;
+   LinuxOptions->Directory = Directory;
 
    File = ReadLinuxOptionsFile(LoaderPath, Volume);
    if (File != NULL) {
-      TokenCount = ReadTokenLine(File, &TokenList);
-      if (TokenCount > 1)
-         Options = StrDuplicate(TokenList[1]);
-      FreeTokenLine(&TokenList, &TokenCount);
+      while ((TokenCount = ReadTokenLine(File, &TokenList)) > 0) {
+         i = LinuxOptions->LineCount;
+         AddListElement((VOID ***) &(LinuxOptions->Titles), &i, StrDuplicate(TokenList[0]));
+         AddListElement((VOID ***) &(LinuxOptions->Options), &(LinuxOptions->LineCount),
+                        (TokenCount > 1) ? StrDuplicate(TokenList[1]) : NULL);
+         FreeTokenLine(&TokenList, &TokenCount);
+      } // while
+      FreeRefitFile(File);
       FreePool(File);
    } // if
+
+   AddListElement((VOID ***) &LinuxOptionsCache, &LinuxOptionsCacheCount, LinuxOptions);
+   return (LinuxOptions->LineCount > 0) ? LinuxOptions : NULL;
+} // LINUX_OPTIONS * GetLinuxOptions()
+
+// Discard the options cached by GetLinuxOptions(). Called at the end of each
+// scan, since the volumes on which the options files reside may change.
+VOID FreeLinuxOptionsCache(VOID) {
+   UINTN          i, j;
+   LINUX_OPTIONS  *LinuxOptions;
+
+   for (i = 0; i < LinuxOptionsCacheCount; i++) {
+      LinuxOptions = LinuxOptionsCache[i];
+      for (j = 0; j < LinuxOptions->LineCount; j++) {
+         MyFreePool(LinuxOptions->Titles[j]);
+         MyFreePool(LinuxOptions->Options[j]);
+      } // for
+      MyFreePool(LinuxOptions->Titles);
+      MyFreePool(LinuxOptions->Options);
+      MyFreePool(LinuxOptions->Directory);
+      MyFreePool(LinuxOptions);
+   } // for
+   MyFreePool(LinuxOptionsCache);
+   LinuxOptionsCache = NULL;
+   LinuxOptionsCacheCount = 0;
+} // VOID FreeLinuxOptionsCache()
+
+// Retrieve a single line of options from a Linux kernel options file
+CHAR16 * GetFirstOptionsFromFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume) {
+   CHAR16         *Options = NULL;
+   LINUX_OPTIONS  *LinuxOptions;
+
+   LinuxOptions = GetLinuxOptions(LoaderPath, Volume);
+   if ((LinuxOptions != NULL) && (LinuxOptions->Options[0] != NULL))
+      Options = StrDuplicate(LinuxOptions->Options[0]);
    return Options;
 } // static CHAR16 * GetOptionsFile()
 
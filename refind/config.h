@@ -58,16 +58,44 @@
 // config module
 //
 
+// A configuration file as tokenized by ReadConfigFile(), kept so that it needn't
+// be tokenized again while it's unchanged. The tokens of line n are
+// Tokens[LineStarts[n]] through Tokens[LineStarts[n + 1] - 1].
+typedef struct _CONFIG_CACHE {
+    CHAR16                *FileName;
+    UINT64                FileSize;
+    EFI_TIME              ModificationTime;
+    UINT32                Crc;          // of the text before it was tokenized
+    UINT8                 *Text;        // the tokenized text, into which Tokens point
+    CHAR16                **Tokens;
+    UINTN                 *LineStarts;  // LineCount + 1 entries
+    UINTN                 LineCount;
+    struct _CONFIG_CACHE  *NextEntry;
+} CONFIG_CACHE;
+
 typedef struct {
-    UINT8   *Buffer;
-    UINTN   BufferSize;
-    UINTN   Encoding;
-    CHAR8   *Current8Ptr;
-    CHAR8   *End8Ptr;
-    CHAR16  *Current16Ptr;
-    CHAR16  *End16Ptr;
+    UINT8         *Buffer;
+    UINTN         BufferSize;
+    UINTN         Encoding;
+    CHAR16        *Current16Ptr;
+    CHAR16        *End16Ptr;
+    CHAR16        **TokenList;      // reused by each ReadTokenLine() call
+    UINTN         TokenListSize;
+    EFI_TIME      ModificationTime;
+    CONFIG_CACHE  *Cache;           // if set, ReadTokenLine() returns lines from here
+    UINTN         CacheLine;        // next line of Cache to return
 } REFIT_FILE;
 
+// The options for the Linux kernels in one directory, as read from
+// refind_linux.conf or generated from /etc/fstab
+typedef struct {
+    REFIT_VOLUME *Volume;
+    CHAR16       *Directory;
+    UINTN        LineCount;
+    CHAR16       **Titles;    // first token on each line
+    CHAR16       **Options;   // second token on each line, or NULL
+} LINUX_OPTIONS;
+
 #define HIDEUI_FLAG_NONE       (0x0000)
 #define HIDEUI_FLAG_BANNER     (0x0001)
 #define HIDEUI_FLAG_LABEL      (0x0002)
@@ -90,7 +118,9 @@ VOID ReadConfig(CHAR16 *FileName);
 VOID ScanUserConfigured(CHAR16 *FileName);
 UINTN ReadTokenLine(IN REFIT_FILE *File, OUT CHAR16 ***TokenList);
 VOID FreeTokenLine(IN OUT CHAR16 ***TokenList, IN OUT UINTN *TokenCount);
-REFIT_FILE * ReadLinuxOptionsFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
+VOID FreeRefitFile(IN OUT REFIT_FILE *File);
+LINUX_OPTIONS * GetLinuxOptions(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
+VOID FreeLinuxOptionsCache(VOID);
 CHAR16 * GetFirstOptionsFromFile(IN CHAR16 *LoaderPath, IN REFIT_VOLUME *Volume);
 
 #endif
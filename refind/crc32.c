@@ -91,13 +91,61 @@ static UINT32 crc32_tab[] = {
    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/*
+ * Tables for the "slice-by-8" algorithm: crc32_slice_tab[k][n] is the CRC
+ * register contribution of byte n followed by k + 1 zero bytes. With them,
+ * crc32() can consume eight bytes per step with eight independent lookups,
+ * rather than one byte per step with a serial dependency. They're derived
+ * from crc32_tab on first use. (Note that this assumes a little-endian CPU,
+ * as do all EFI platforms.)
+ */
+static UINT32 crc32_slice_tab[7][256];
+static BOOLEAN crc32_slice_tab_ready = FALSE;
+
+static VOID crc32_init_slices(VOID)
+{
+   UINTN  n, k;
+   UINT32 c;
+
+   for (n = 0; n < 256; n++) {
+      c = crc32_tab[n];
+      for (k = 0; k < 7; k++) {
+         c = crc32_tab[c & 0xFF] ^ (c >> 8);
+         crc32_slice_tab[k][n] = c;
+      }
+   }
+   crc32_slice_tab_ready = TRUE;
+}
+
 UINT32 crc32(UINT32 crc, const VOID *buf, UINTN size)
 {
    const UINT8 *p;
+   UINT32 lo, hi;
 
    p = buf;
    crc = crc ^ ~0U;
 
+   if (size >= 16) {
+      if (!crc32_slice_tab_ready)
+         crc32_init_slices();
+
+      // Byte-wise up to a 4-byte boundary, then eight bytes at a time....
+      while ((UINTN) p & 3) {
+         crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+         size--;
+      }
+      while (size >= 8) {
+         lo = *(const UINT32 *) p ^ crc;
+         hi = *(const UINT32 *) (p + 4);
+         crc = crc32_slice_tab[6][lo & 0xFF] ^ crc32_slice_tab[5][(lo >> 8) & 0xFF] ^
+               crc32_slice_tab[4][(lo >> 16) & 0xFF] ^ crc32_slice_tab[3][lo >> 24] ^
+               crc32_slice_tab[2][hi & 0xFF] ^ crc32_slice_tab[1][(hi >> 8) & 0xFF] ^
+               crc32_slice_tab[0][(hi >> 16) & 0xFF] ^ crc32_tab[hi >> 24];
+         p += 8;
+         size -= 8;
+      }
+   }
+
    while (size--)
       crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
 
@@ -249,3 +249,176 @@ Error:
 
   return Status;
 } /* EFI_STATUS LibScanHandleDatabase() */
+
+//
+// Open-addressed table mapping EFI_HANDLE values to their indexes in a handle
+// buffer, used by LibClassifyHandleDatabase()
+//
+#define HANDLE_INDEX_EMPTY 0xffffffff
+
+static
+UINTN
+HashHandle (
+  EFI_HANDLE  Handle,
+  UINTN       TableSize
+  )
+{
+  UINTN  Value;
+
+  Value = (UINTN) Handle;
+  return ((Value >> 3) ^ (Value >> 11)) & (TableSize - 1);
+}
+
+static
+UINTN
+FindHandleIndex (
+  EFI_HANDLE  Handle,
+  EFI_HANDLE  *HandleBuffer,
+  UINT32      *Table,
+  UINTN       TableSize
+  )
+{
+  UINTN  Slot;
+
+  Slot = HashHandle (Handle, TableSize);
+  while (Table[Slot] != HANDLE_INDEX_EMPTY) {
+    if (HandleBuffer[Table[Slot]] == Handle) {
+      return Table[Slot];
+    }
+    Slot = (Slot + 1) & (TableSize - 1);
+  }
+  return HANDLE_INDEX_EMPTY;
+}
+
+//
+// Classify every handle in the handle database in a single pass, without
+// reference to any particular driver or controller. On return, each entry in
+// *HandleType has the IMAGE_HANDLE, DRIVER_BINDING_HANDLE and DEVICE_HANDLE
+// bits set according to the handle's protocols; PARENT_HANDLE if a driver has
+// created child controllers from it; and CHILD_HANDLE if it is such a child.
+// LibScanHandleDatabase() would need one call, each walking the whole
+// database, per handle to collect the same information.
+//
+EFI_STATUS
+LibClassifyHandleDatabase (
+  UINTN       *HandleCount,
+  EFI_HANDLE  **HandleBuffer,
+  UINT32      **HandleType
+  )
+{
+  EFI_STATUS                          Status;
+  UINTN                               HandleIndex;
+  EFI_GUID                            **ProtocolGuidArray;
+  UINTN                               ArrayCount;
+  UINTN                               ProtocolIndex;
+  EFI_OPEN_PROTOCOL_INFORMATION_ENTRY *OpenInfo;
+  UINTN                               OpenInfoCount;
+  UINTN                               OpenInfoIndex;
+  UINTN                               ChildIndex;
+  UINT32                              *Table;
+  UINTN                               TableSize;
+  UINTN                               Slot;
+
+  *HandleCount  = 0;
+  *HandleBuffer = NULL;
+  *HandleType   = NULL;
+  Table         = NULL;
+
+  Status = refit_call5_wrapper(BS->LocateHandleBuffer,
+     AllHandles,
+     NULL,
+     NULL,
+     HandleCount,
+     HandleBuffer
+  );
+  if (EFI_ERROR (Status)) {
+    goto Error;
+  }
+
+  TableSize = 64;
+  while (TableSize < *HandleCount * 2) {
+    TableSize *= 2;
+  }
+  *HandleType = AllocateZeroPool (*HandleCount * sizeof (UINT32));
+  Table       = AllocatePool (TableSize * sizeof (UINT32));
+  if ((*HandleType == NULL) || (Table == NULL)) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Error;
+  }
+
+  SetMem (Table, TableSize * sizeof (UINT32), 0xff);
+  for (HandleIndex = 0; HandleIndex < *HandleCount; HandleIndex++) {
+    Slot = HashHandle ((*HandleBuffer)[HandleIndex], TableSize);
+    while (Table[Slot] != HANDLE_INDEX_EMPTY) {
+      Slot = (Slot + 1) & (TableSize - 1);
+    }
+    Table[Slot] = (UINT32) HandleIndex;
+  }
+
+  for (HandleIndex = 0; HandleIndex < *HandleCount; HandleIndex++) {
+    Status = refit_call3_wrapper(BS->ProtocolsPerHandle,
+                  (*HandleBuffer)[HandleIndex],
+                  &ProtocolGuidArray,
+                  &ArrayCount
+                  );
+    if (EFI_ERROR (Status)) {
+      continue;
+    }
+
+    for (ProtocolIndex = 0; ProtocolIndex < ArrayCount; ProtocolIndex++) {
+      if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiLoadedImageProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_IMAGE_HANDLE;
+      }
+
+      if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiDriverBindingProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE;
+      }
+
+      if (CompareGuid (ProtocolGuidArray[ProtocolIndex], &gEfiDevicePathProtocolGuid) == 0) {
+        (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_DEVICE_HANDLE;
+      }
+
+      Status = refit_call4_wrapper(BS->OpenProtocolInformation,
+                    (*HandleBuffer)[HandleIndex],
+                    ProtocolGuidArray[ProtocolIndex],
+                    &OpenInfo,
+                    &OpenInfoCount
+                    );
+      if (EFI_ERROR (Status)) {
+        continue;
+      }
+
+      for (OpenInfoIndex = 0; OpenInfoIndex < OpenInfoCount; OpenInfoIndex++) {
+        if ((OpenInfo[OpenInfoIndex].Attributes & EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) ==
+            EFI_OPEN_PROTOCOL_BY_CHILD_CONTROLLER) {
+          //
+          // A driver has made OpenInfo[].ControllerHandle a child of this handle
+          //
+          (*HandleType)[HandleIndex] |= EFI_HANDLE_TYPE_PARENT_HANDLE;
+          ChildIndex = FindHandleIndex (OpenInfo[OpenInfoIndex].ControllerHandle, *HandleBuffer, Table, TableSize);
+          if (ChildIndex != HANDLE_INDEX_EMPTY) {
+            (*HandleType)[ChildIndex] |= EFI_HANDLE_TYPE_CHILD_HANDLE;
+          }
+        }
+      }
+
+      MyFreePool (OpenInfo);
+    }
+
+    MyFreePool (ProtocolGuidArray);
+  }
+
+  MyFreePool (Table);
+  return EFI_SUCCESS;
+
+Error:
+  MyFreePool (Table);
+  MyFreePool (*HandleType);
+  MyFreePool (*HandleBuffer);
+
+  *HandleCount  = 0;
+  *HandleBuffer = NULL;
+  *HandleType   = NULL;
+
+  return Status;
+} /* EFI_STATUS LibClassifyHandleDatabase() */
@@ -41,6 +41,17 @@ LibScanHandleDatabase (
   UINT32      **HandleType
   );
 
+EFI_STATUS
+LibClassifyHandleDatabase (
+  UINTN       *HandleCount,
+  EFI_HANDLE  **HandleBuffer,
+  UINT32      **HandleType
+  );
+
+
+#ifdef __MAKEWITH_GNUEFI
+extern EFI_GUID gEfiDriverBindingProtocolGuid;
+#endif
 
 #define EFI_HANDLE_TYPE_UNKNOWN                     0x000
 #define EFI_HANDLE_TYPE_IMAGE_HANDLE                0x001
@@ -124,11 +124,17 @@
 #define FS_TYPE_REISERFS       6
 #define FS_TYPE_BTRFS          7
 #define FS_TYPE_ISO9660        8
+#define FS_TYPE_XFS            9
+#define FS_TYPE_NTFS           10
 
 // How to scale banner images
 #define BANNER_NOSCALE         0
 #define BANNER_FILLSCREEN      1
 
+// How to sort boot loaders within a directory
+#define SORT_BY_DATE           0
+#define SORT_BY_VERSION        1
+
 // Sizes of the default icons; badges are 1/4 the big icon size
 #define DEFAULT_SMALL_ICON_SIZE 48
 #define DEFAULT_BIG_ICON_SIZE   128
@@ -181,6 +187,8 @@ typedef struct {
    UINTN               VolNumber;
    EG_IMAGE            *VolIconImage;
    EG_IMAGE            *VolBadgeImage;
+   BOOLEAN             OwnsIconImage;  // TRUE if VolIconImage was loaded from this volume
+   BOOLEAN             OwnsBadgeImage; // TRUE if VolBadgeImage was loaded from this volume
    UINTN               DiskKind;
    BOOLEAN             IsAppleLegacy;
    BOOLEAN             HasBootCode;
@@ -189,12 +197,18 @@ typedef struct {
    BOOLEAN             IsMbrPartition;
    UINTN               MbrPartitionIndex;
    EFI_BLOCK_IO        *BlockIO;
+   UINT32              MediaId;       // BlockIO's MediaId when the volume was scanned
    UINT64              BlockIOOffset;
    EFI_BLOCK_IO        *WholeDiskBlockIO;
    EFI_DEVICE_PATH     *WholeDiskDevicePath;
    MBR_PARTITION_INFO  *MbrPartitionTable;
-   BOOLEAN             IsReadable;
+   BOOLEAN             ProbedReadable; // TRUE if RootDir could be opened
+   BOOLEAN             IsReadable;     // ProbedReadable and no other volume has the same UUID
    UINT32              FSType;
+   CHAR16              *FsLabel;      // label read from the superblock; NULL if empty or unknown
+   BOOLEAN             FsLabelKnown;  // TRUE if FsLabel came from the superblock (even if empty)
+   UINT64              FsSize;        // filesystem size from the superblock, in bytes; 0 if unknown
+   BOOLEAN             IsNew;         // probed by the latest ScanVolumes() rather than kept from an earlier one
 } REFIT_VOLUME;
 
 typedef struct _refit_menu_entry {
@@ -232,6 +246,7 @@ typedef struct {
    CHAR16           *LoadOptions;
    CHAR16           *InitrdPath; // Linux stub loader only
    CHAR8            OSType;
+   REFIT_VOLUME     *Volume;     // volume holding the loader or tool; NULL if not found by ScanVolumes()
 } LOADER_ENTRY;
 
 typedef struct {
@@ -246,6 +261,8 @@ typedef struct {
    BOOLEAN     TextOnly;
    BOOLEAN     ScanAllLinux;
    BOOLEAN     DeepLegacyScan;
+   BOOLEAN     UseLinearFramebuffer;
+   BOOLEAN     TargetedDriverConnect;
    UINTN       RequestedScreenWidth;
    UINTN       RequestedScreenHeight;
    UINTN       BannerBottomEdge;
@@ -259,6 +276,7 @@ typedef struct {
    UINTN       ScreensaverTime;
    UINTN       IconSizes[3];
    UINTN       BannerScale;
+   UINTN       SortBy;
    CHAR16      *BannerFileName;
    EG_IMAGE    *ScreenBackground;
    CHAR16      *ConfigFilename;
@@ -287,6 +305,7 @@ extern CHAR16           *SelfDirPath;
 extern REFIT_VOLUME     *SelfVolume;
 extern REFIT_VOLUME     **Volumes;
 extern UINTN            VolumesCount;
+extern EFI_EVENT        NewVolumeEvent;
 
 extern REFIT_CONFIG     GlobalConfig;
 
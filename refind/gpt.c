@@ -23,6 +23,13 @@
 
 extern GPT_DATA *gPartitions;
 
+// Largest partition table (in entries) that rEFInd will accept
+#define GPT_MAX_ENTRIES          (16384)
+
+// Number of partition entries read along with the MBR and GPT header;
+// anything beyond this (or not starting at LBA 2) takes a second read.
+#define GPT_MAX_ENTRIES_IN_CACHE (128)
+
 // Allocate data for the main GPT_DATA structure, as well as the ProtectiveMBR
 // and Header structures it contains. This function does *NOT*, however,
 // allocate memory for the Entries data structure, since its size is variable
@@ -60,57 +67,99 @@ VOID ClearGptData(GPT_DATA *Data) {
 
 // TODO: Make this work on big-endian systems; at the moment, it contains
 // little-endian assumptions!
-// Returns TRUE if the GPT protective MBR and header data appear valid,
-// FALSE otherwise.
-static BOOLEAN GptHeaderValid(GPT_DATA *GptData) {
+// Returns TRUE if the MBR appears to be a GPT protective MBR, FALSE otherwise.
+static BOOLEAN ProtectiveMbrValid(MBR_RECORD *Mbr) {
+   return ((Mbr->MBRSignature == 0xAA55) &&
+           ((Mbr->partitions[0].type == 0xEE) || (Mbr->partitions[1].type == 0xEE) ||
+            (Mbr->partitions[2].type == 0xEE) || (Mbr->partitions[3].type == 0xEE)));
+} // static BOOLEAN ProtectiveMbrValid()
+
+// Returns TRUE if the GPT header data appear valid, FALSE otherwise.
+static BOOLEAN GptHeaderValid(GPT_HEADER *Header) {
    BOOLEAN IsValid;
    UINT32 CrcValue, StoredCrcValue;
    UINTN HeaderSize = sizeof(GPT_HEADER);
 
-   if ((GptData == NULL) || (GptData->ProtectiveMBR == NULL) || (GptData->Header == NULL))
+   if (Header == NULL)
       return FALSE;
 
-   IsValid = (GptData->ProtectiveMBR->MBRSignature == 0xAA55);
-   IsValid = IsValid && ((GptData->ProtectiveMBR->partitions[0].type == 0xEE) ||
-                         (GptData->ProtectiveMBR->partitions[1].type == 0xEE) ||
-                         (GptData->ProtectiveMBR->partitions[2].type == 0xEE) ||
-                         (GptData->ProtectiveMBR->partitions[3].type == 0xEE));
-
-   IsValid = IsValid && ((GptData->Header->signature == 0x5452415020494645ULL) &&
-                         (GptData->Header->spec_revision == 0x00010000) &&
-                         (GptData->Header->entry_size == 128));
+   IsValid = ((Header->signature == 0x5452415020494645ULL) &&
+              (Header->spec_revision == 0x00010000) &&
+              (Header->entry_size == 128) &&
+              (Header->entry_count > 0) && (Header->entry_count <= GPT_MAX_ENTRIES));
 
    // Looks good so far; check CRC value....
    if (IsValid) {
-      if (GptData->Header->header_size < HeaderSize)
-         HeaderSize = GptData->Header->header_size;
-      StoredCrcValue = GptData->Header->header_crc32;
-      GptData->Header->header_crc32 = 0;
-      CrcValue = crc32(0x0, GptData->Header, HeaderSize);
+      if (Header->header_size < HeaderSize)
+         HeaderSize = Header->header_size;
+      StoredCrcValue = Header->header_crc32;
+      Header->header_crc32 = 0;
+      CrcValue = crc32(0x0, Header, HeaderSize);
       if (CrcValue != StoredCrcValue)
          IsValid = FALSE;
-      GptData->Header->header_crc32 = StoredCrcValue;
+      Header->header_crc32 = StoredCrcValue;
    } // if
 
    return IsValid;
 } // BOOLEAN GptHeaderValid()
 
+// Load the partition entries described by Header into GptData->Entries and
+// check their CRC. If they lie within the Cache buffer (which holds the first
+// CacheBlocks blocks of the disk), they're copied from there; otherwise
+// they're read from the disk.
+static EFI_STATUS ReadGptEntries(EFI_BLOCK_IO *BlockIO, GPT_HEADER *Header, UINT8 *Cache, UINTN CacheBlocks,
+                                 GPT_DATA *GptData) {
+   EFI_STATUS Status = EFI_SUCCESS;
+   UINTN      i, BufferSize, BlockSize, NumBlocks;
+
+   BlockSize = BlockIO->Media->BlockSize;
+   BufferSize = Header->entry_count * 128;
+   NumBlocks = (BufferSize + BlockSize - 1) / BlockSize;
+
+   MyFreePool(GptData->Entries);
+   GptData->Entries = AllocatePool(NumBlocks * BlockSize);
+   if (GptData->Entries == NULL)
+      return EFI_OUT_OF_RESOURCES;
+
+   if ((Header->entry_lba < CacheBlocks) && ((UINTN) Header->entry_lba + NumBlocks <= CacheBlocks)) {
+      CopyMem(GptData->Entries, Cache + (UINTN) Header->entry_lba * BlockSize, BufferSize);
+   } else {
+      Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId,
+                                   Header->entry_lba, NumBlocks * BlockSize, GptData->Entries);
+   }
+
+   // Check CRC status of table
+   if ((Status == EFI_SUCCESS) && (crc32(0x0, GptData->Entries, BufferSize) != Header->entry_crc32))
+      Status = EFI_CRC_ERROR;
+
+   // Now, ensure that every name is null-terminated....
+   if (Status == EFI_SUCCESS) {
+      for (i = 0; i < Header->entry_count; i++)
+         GptData->Entries[i].name[35] = '\0';
+   } // if
+   return Status;
+} // static EFI_STATUS ReadGptEntries()
+
 // Read GPT data from Volume and store it in *Data. Note that this function
 // may be called on a Volume that is not in fact a GPT disk (an MBR disk,
 // a partition, etc.), in which case it will return EFI_LOAD_ERROR or some
 // other error condition. In this case, *Data will be left alone.
+// The protective MBR, the primary header, and (on most disks) the primary
+// partition entries are all fetched with a single read of the start of the
+// disk. Only if the primary header or entries are damaged does this function
+// read the backup header (from the disk's last block) and its entries.
 // Note also that this function checks CRCs and does other sanity checks
-// on the input data, but does NOT resort to using the backup data if the
-// primary data structures are damaged. The intent is that the function
-// be very conservative about reading GPT data. Currently (version 0.7.10),
-// rEFInd uses the data only to provide access to partition names. This is
-// non-critical data, so it's OK to return nothing, but having the program
-// hang on reading garbage or return nonsense could be very bad.
+// on the input data. The intent is that the function be very conservative
+// about reading GPT data. Currently (version 0.7.10), rEFInd uses the data
+// only to provide access to partition names. This is non-critical data, so
+// it's OK to return nothing, but having the program hang on reading garbage
+// or return nonsense could be very bad.
 EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data) {
-   EFI_STATUS Status = EFI_SUCCESS;
-   UINT64     BufferSize;
-   UINTN      i;
-   GPT_DATA   *GptData; // Temporary holding storage; transferred to *Data later
+   EFI_STATUS   Status = EFI_SUCCESS;
+   EFI_BLOCK_IO *BlockIO;
+   UINTN        BlockSize = 0, CacheBlocks = 0;
+   UINT8        *Cache = NULL;
+   GPT_DATA     *GptData = NULL; // Temporary holding storage; transferred to *Data later
 
    if ((Volume == NULL) || (Data == NULL))
       return EFI_INVALID_PARAMETER;
@@ -124,56 +173,64 @@ EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data) {
          Status = EFI_NOT_READY;
       }
    } // if
+   BlockIO = Volume->BlockIO;
 
-   if ((Status == EFI_SUCCESS) && ((!Volume->BlockIO->Media->MediaPresent) || (Volume->BlockIO->Media->LogicalPartition)))
+   if ((Status == EFI_SUCCESS) && ((!BlockIO->Media->MediaPresent) || (BlockIO->Media->LogicalPartition)))
       Status = EFI_NO_MEDIA;
 
+   if (Status == EFI_SUCCESS) {
+      BlockSize = BlockIO->Media->BlockSize;
+      if ((BlockSize < sizeof(MBR_RECORD)) || (BlockSize > 65536))
+         Status = EFI_UNSUPPORTED;
+   }
+
    if (Status == EFI_SUCCESS) {
       GptData = AllocateGptData(); // Note: All but GptData->Entries
-      if (GptData == NULL) {
+      // The MBR, the header, and a standard-size (128-entry) partition table
+      CacheBlocks = 2 + (GPT_MAX_ENTRIES_IN_CACHE * 128 + BlockSize - 1) / BlockSize;
+      if ((UINT64) CacheBlocks > BlockIO->Media->LastBlock + 1)
+         CacheBlocks = (UINTN) BlockIO->Media->LastBlock + 1;
+      Cache = AllocatePool(CacheBlocks * BlockSize);
+      if ((GptData == NULL) || (Cache == NULL) || (CacheBlocks < 2)) {
          Status = EFI_OUT_OF_RESOURCES;
       } // if
    } // if
 
-   // Read the MBR and store it in GptData->ProtectiveMBR.
+   // Read the start of the disk and split out the MBR and GPT header.
    if (Status == EFI_SUCCESS) {
-      Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks, Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                   0, sizeof(MBR_RECORD), (VOID*) GptData->ProtectiveMBR);
+      Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId,
+                                   0, CacheBlocks * BlockSize, Cache);
    }
-
-   // Read the GPT header and store it in GptData->Header.
    if (Status == EFI_SUCCESS) {
-      Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks, Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                   1, sizeof(GPT_HEADER), GptData->Header);
+      CopyMem(GptData->ProtectiveMBR, Cache, sizeof(MBR_RECORD));
+      CopyMem(GptData->Header, Cache + BlockSize, sizeof(GPT_HEADER));
+      if (!ProtectiveMbrValid(GptData->ProtectiveMBR))
+         Status = EFI_UNSUPPORTED;
    }
 
    // If it looks like a valid protective MBR & GPT header, try to do more with it....
    if (Status == EFI_SUCCESS) {
-      if (GptHeaderValid(GptData)) {
-         // Load actual GPT table....
-         BufferSize = GptData->Header->entry_count * 128;
-         GptData->Entries = AllocatePool(BufferSize);
-         if (GptData->Entries == NULL)
-            Status = EFI_OUT_OF_RESOURCES;
-
-         if (Status == EFI_SUCCESS)
-            Status = refit_call5_wrapper(Volume->BlockIO->ReadBlocks, Volume->BlockIO, Volume->BlockIO->Media->MediaId,
-                                         GptData->Header->entry_lba, BufferSize, GptData->Entries);
-
-         // Check CRC status of table
-         if ((Status == EFI_SUCCESS) && (crc32(0x0, GptData->Entries, BufferSize) != GptData->Header->entry_crc32))
-            Status = EFI_CRC_ERROR;
-
-         // Now, ensure that every name is null-terminated....
+      if (GptHeaderValid(GptData->Header))
+         Status = ReadGptEntries(BlockIO, GptData->Header, Cache, CacheBlocks, GptData);
+      else
+         Status = EFI_CRC_ERROR;
+
+      // Primary data damaged; fall back on the backup header and entries....
+      if (Status != EFI_SUCCESS) {
+         CacheBlocks = 0;
+         Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId,
+                                      BlockIO->Media->LastBlock, BlockSize, Cache);
          if (Status == EFI_SUCCESS) {
-            for (i = 0; i < GptData->Header->entry_count; i++)
-               GptData->Entries[i].name[35] = '\0';
+            CopyMem(GptData->Header, Cache, sizeof(GPT_HEADER));
+            if (GptHeaderValid(GptData->Header))
+               Status = ReadGptEntries(BlockIO, GptData->Header, Cache, CacheBlocks, GptData);
+            else
+               Status = EFI_UNSUPPORTED;
          } // if
-      } else {
-         Status = EFI_UNSUPPORTED;
-      } // if/else valid header
-   } // if header read OK
+      } // if primary data bad
+   } // if protective MBR OK
 
+   MyFreePool(Cache);
    if (Status == EFI_SUCCESS) {
       // Everything looks OK, so copy it over
       ClearGptData(*Data);
@@ -185,29 +242,87 @@ EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data) {
    return Status;
 } // EFI_STATUS ReadGptData()
 
+// Hash table of all the partitions in gPartitions, keyed by partition GUID,
+// for PartNameFromGuid(). It's an open-addressed table of at least twice as
+// many slots as there are partitions, built when first needed after
+// gPartitions changes.
+static GPT_ENTRY  **PartHash = NULL;
+static UINTN      PartHashSize = 0;
+static BOOLEAN    PartHashStale = TRUE;
+
+// Partition GUIDs are (mostly) random, so a few of their bytes make a fine hash.
+static UINTN HashPartGuid(UINT8 *Guid) {
+   return (UINTN) (*((UINT32*) Guid) ^ *((UINT32*) (Guid + 12)));
+} // static UINTN HashPartGuid()
+
+// Returns TRUE if Entry describes a partition (as opposed to being an empty slot)
+static BOOLEAN PartitionInUse(GPT_ENTRY *Entry) {
+   UINTN i;
+
+   for (i = 0; i < 16; i++) {
+      if (Entry->type_guid[i] != 0)
+         return TRUE;
+   }
+   return FALSE;
+} // static BOOLEAN PartitionInUse()
+
+// (Re)build PartHash from gPartitions.
+static VOID BuildPartHash(VOID) {
+   GPT_DATA  *GptData;
+   UINTN     i, Slot, NumParts = 0;
+
+   MyFreePool(PartHash);
+   PartHash = NULL;
+   PartHashSize = 0;
+   PartHashStale = FALSE;
+
+   for (GptData = gPartitions; GptData != NULL; GptData = GptData->NextEntry)
+      NumParts += GptData->Header->entry_count;
+   if (NumParts == 0)
+      return;
+
+   PartHashSize = 16;
+   while (PartHashSize < NumParts * 2)
+      PartHashSize *= 2;
+   PartHash = AllocateZeroPool(PartHashSize * sizeof(GPT_ENTRY*));
+   if (PartHash == NULL) {
+      PartHashSize = 0;
+      return;
+   }
+
+   for (GptData = gPartitions; GptData != NULL; GptData = GptData->NextEntry) {
+      for (i = 0; i < GptData->Header->entry_count; i++) {
+         if (!PartitionInUse(&(GptData->Entries[i])))
+            continue;
+         Slot = HashPartGuid(GptData->Entries[i].partition_guid) & (PartHashSize - 1);
+         while (PartHash[Slot] != NULL)
+            Slot = (Slot + 1) & (PartHashSize - 1);
+         PartHash[Slot] = &(GptData->Entries[i]);
+      } // for (entries)
+   } // for (GPTs)
+} // static VOID BuildPartHash()
+
 // Look in gPartitions for a partition with the specified Guid. If found, return
 // a pointer to that partition's name string. If not found, return a NULL pointer.
 // The calling function is responsible for freeing the returned memory.
 CHAR16 * PartNameFromGuid(EFI_GUID *Guid) {
-   UINTN     i;
-   CHAR16    *Found = NULL;
-   GPT_DATA  *GptData;
+   UINTN     Slot;
 
    if ((Guid == NULL) || (gPartitions == NULL))
       return NULL;
 
-   GptData = gPartitions;
-   while ((GptData != NULL) && (!Found)) {
-      i = 0;
-      while ((i < GptData->Header->entry_count) && (!Found)) {
-         if (GuidsAreEqual((EFI_GUID*) &(GptData->Entries[i].partition_guid), Guid))
-            Found = StrDuplicate(GptData->Entries[i].name);
-         else
-            i++;
-      } // while(scanning entries)
-      GptData = GptData->NextEntry;
-   } // while(scanning GPTs)
-   return Found;
+   if (PartHashStale)
+      BuildPartHash();
+   if (PartHash == NULL)
+      return NULL;
+
+   Slot = HashPartGuid((UINT8*) Guid) & (PartHashSize - 1);
+   while (PartHash[Slot] != NULL) {
+      if (GuidsAreEqual((EFI_GUID*) &(PartHash[Slot]->partition_guid), Guid))
+         return StrDuplicate(PartHash[Slot]->name);
+      Slot = (Slot + 1) & (PartHashSize - 1);
+   } // while
+   return NULL;
 } // CHAR16 * PartNameFromGuid()
 
 // Erase the gPartitions linked-list data structure
@@ -219,31 +334,103 @@ VOID ForgetPartitionTables(VOID) {
       ClearGptData(gPartitions);
       gPartitions = Next;
    } // while
+   PartHashStale = TRUE;
 } // VOID ForgetPartitionTables()
 
+// Erase the GPTs of disks that haven't been passed to AddPartitionTable()
+// since the last call to this function -- that is, disks that have gone away.
+VOID ForgetUnusedPartitionTables(VOID) {
+   GPT_DATA  **Link = &gPartitions, *GptData;
+
+   while (*Link != NULL) {
+      GptData = *Link;
+      if (GptData->InUse) {
+         GptData->InUse = FALSE;
+         Link = &(GptData->NextEntry);
+      } else {
+         *Link = GptData->NextEntry;
+         ClearGptData(GptData);
+         PartHashStale = TRUE;
+      } // if/else
+   } // while
+} // VOID ForgetUnusedPartitionTables()
+
+// Returns TRUE if the GPT header on the disk still matches the cached copy in
+// GptData, as judged by its CRCs. This costs one block read, against several
+// for ReadGptData(), and catches changes made by a partitioning tool (such as
+// gdisk run from rEFInd's tools row) without a change of MediaId.
+static BOOLEAN GptDataCurrent(GPT_DATA *GptData) {
+   EFI_STATUS   Status;
+   EFI_BLOCK_IO *BlockIO = GptData->BlockIO;
+   GPT_HEADER   *Header;
+   BOOLEAN      Current = FALSE;
+
+   Header = AllocatePool(BlockIO->Media->BlockSize);
+   if (Header == NULL)
+      return FALSE;
+   Status = refit_call5_wrapper(BlockIO->ReadBlocks, BlockIO, BlockIO->Media->MediaId,
+                                GptData->Header->header_lba, BlockIO->Media->BlockSize, Header);
+   if ((Status == EFI_SUCCESS) && (Header->signature == GptData->Header->signature) &&
+       (Header->header_crc32 == GptData->Header->header_crc32) &&
+       (Header->entry_crc32 == GptData->Header->entry_crc32))
+      Current = TRUE;
+   MyFreePool(Header);
+   return Current;
+} // static BOOLEAN GptDataCurrent()
+
 // If Volume points to a whole disk with a GPT, add it to the gPartitions
-// linked list of GPTs.
+// linked list of GPTs. Each disk's GPT is read in full only once; later calls
+// for the same disk (same BlockIO and medium) check that its header hasn't
+// changed and mark the existing copy as still in use.
 VOID AddPartitionTable(REFIT_VOLUME *Volume) {
-   GPT_DATA    *GptData = NULL, *GptList;
+   GPT_DATA    *GptData = NULL, *GptList, **Link;
    EFI_STATUS  Status;
-   UINTN       NumTables = 1;
+
+   if (Volume == NULL)
+      return;
+
+   // New volumes don't have their BlockIO yet, and we need it to find the cached GPT
+   if (Volume->BlockIO == NULL) {
+      Status = refit_call3_wrapper(BS->HandleProtocol, Volume->DeviceHandle, &BlockIoProtocol, (VOID **) &(Volume->BlockIO));
+      if (EFI_ERROR(Status)) {
+         Volume->BlockIO = NULL;
+         return;
+      }
+   } // if
+   if (Volume->BlockIO->Media->LogicalPartition)
+      return;
+
+   for (Link = &gPartitions; *Link != NULL; Link = &((*Link)->NextEntry)) {
+      GptList = *Link;
+      if ((GptList->BlockIO == Volume->BlockIO) && (GptList->MediaId == Volume->BlockIO->Media->MediaId)) {
+         if (GptDataCurrent(GptList)) {
+            GptList->InUse = TRUE;
+            return;
+         }
+         // The partition table has changed; drop the old copy and read it again
+         *Link = GptList->NextEntry;
+         ClearGptData(GptList);
+         PartHashStale = TRUE;
+         break;
+      } // if
+   } // for
 
    Status = ReadGptData(Volume, &GptData);
    if (Status == EFI_SUCCESS) {
+      GptData->BlockIO = Volume->BlockIO;
+      GptData->MediaId = Volume->BlockIO->Media->MediaId;
+      GptData->InUse = TRUE;
       if (gPartitions == NULL) {
          gPartitions = GptData;
       } else {
          GptList = gPartitions;
-         while (GptList->NextEntry != NULL) {
+         while (GptList->NextEntry != NULL)
             GptList = GptList->NextEntry;
-            NumTables++;
-         } // while
          GptList->NextEntry = GptData;
-         NumTables++;
       } // if/else
+      PartHashStale = TRUE;
    } else if (GptData != NULL) {
       ClearGptData(GptData);
-      NumTables = 0;
    } // if/else
 } // VOID AddPartitionTable()
 
@@ -75,6 +75,9 @@ typedef struct _gpt_data {
    MBR_RECORD         *ProtectiveMBR;
    GPT_HEADER         *Header;
    GPT_ENTRY          *Entries;
+   EFI_BLOCK_IO       *BlockIO;    // disk this GPT was read from
+   UINT32             MediaId;     // ...and its MediaId at the time
+   BOOLEAN            InUse;       // seen since last ForgetUnusedPartitionTables()
    struct _gpt_data   *NextEntry;
 } GPT_DATA;
 
@@ -84,6 +87,7 @@ VOID ClearGptData(GPT_DATA *Data);
 EFI_STATUS ReadGptData(REFIT_VOLUME *Volume, GPT_DATA **Data);
 CHAR16 * PartNameFromGuid(EFI_GUID *Guid);
 VOID ForgetPartitionTables(VOID);
+VOID ForgetUnusedPartitionTables(VOID);
 VOID AddPartitionTable(REFIT_VOLUME *Volume);
 
 #endif
\ No newline at end of file
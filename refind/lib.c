@@ -48,6 +48,7 @@
 #include "screen.h"
 #include "../include/refit_call_wrapper.h"
 #include "../include/RemovableMedia.h"
+#include "../include/bootcode.h"
 #include "gpt.h"
 
 #ifdef __MAKEWITH_GNUEFI
@@ -56,6 +57,7 @@
 #define LibLocateHandle gBS->LocateHandleBuffer
 #define DevicePathProtocol gEfiDevicePathProtocolGuid
 #define BlockIoProtocol gEfiBlockIoProtocolGuid
+#define FileSystemProtocol gEfiSimpleFileSystemProtocolGuid
 #define LibFileSystemInfo EfiLibFileSystemInfo
 #define LibOpenRoot EfiLibOpenRoot
 EFI_DEVICE_PATH EndDevicePath[] = {
@@ -74,6 +76,8 @@ EFI_DEVICE_PATH EndDevicePath[] = {
 #define REISER2FS_SUPER_MAGIC_STRING     "ReIsEr2Fs"
 #define REISER2FS_JR_SUPER_MAGIC_STRING  "ReIsEr3Fs"
 #define BTRFS_SIGNATURE                  "_BHRfS_M"
+#define XFS_SIGNATURE                    "XFSB"
+#define NTFS_SIGNATURE                   "NTFS    "
 
 // variables
 
@@ -88,6 +92,11 @@ REFIT_VOLUME     **Volumes = NULL;
 UINTN            VolumesCount = 0;
 extern GPT_DATA *gPartitions;
 
+// Signalled by the firmware when a disk or filesystem appears; see WatchForNewVolumes()
+EFI_EVENT        NewVolumeEvent = NULL;
+static VOID      *BlockIoRegistration;
+static VOID      *FileSystemRegistration;
+
 // Maximum size for disk sectors
 #define SECTOR_SIZE 4096
 
@@ -95,6 +104,9 @@ extern GPT_DATA *gPartitions;
 // and identify its boot loader, and hence probable BIOS-mode OS installation
 #define SAMPLE_SIZE 69632 /* 68 KiB -- ReiserFS superblock begins at 64 KiB */
 
+// Flags returned by FindVolumeIconFiles()
+#define VOLUME_FILE_BADGE (1)
+#define VOLUME_FILE_ICON  (2)
 
 // functions
 
@@ -102,6 +114,8 @@ static EFI_STATUS FinishInitRefitLib(VOID);
 
 static VOID UninitVolumes(VOID);
 
+static UINTN FindVolumeIconFiles(IN REFIT_VOLUME *Volume);
+
 //
 // self recognition stuff
 //
@@ -458,6 +472,12 @@ static CHAR16 *FSTypeName(IN UINT32 TypeCode) {
       case FS_TYPE_ISO9660:
          retval = L" ISO-9660";
          break;
+      case FS_TYPE_XFS:
+         retval = L" XFS";
+         break;
+      case FS_TYPE_NTFS:
+         retval = L" NTFS";
+         break;
       default:
          retval = L"";
          break;
@@ -465,34 +485,77 @@ static CHAR16 *FSTypeName(IN UINT32 TypeCode) {
    return retval;
 } // CHAR16 *FSTypeName()
 
+// Return the Length-byte big-endian value at Bytes (for XFS and HFS+).
+static UINT64 BigEndianValue(IN UINT8 *Bytes, IN UINTN Length) {
+   UINT64 Value = 0;
+   UINTN  i;
+
+   for (i = 0; i < Length; i++)
+      Value = (Value << 8) | Bytes[i];
+   return Value;
+} // UINT64 BigEndianValue()
+
+// Store the NUL-padded UTF-8 label of up to Length bytes at Bytes in
+// Volume->FsLabel, and flag the label as known, even if it's empty, so that
+// GetVolumeName() needn't ask the filesystem driver for it.
+static VOID SetFilesystemLabel(IN OUT REFIT_VOLUME *Volume, IN UINT8 *Bytes, IN UINTN Length) {
+   UINTN   i, Count;
+   BOOLEAN Valid;
+
+   Volume->FsLabelKnown = TRUE;
+   for (i = 0; (i < Length) && (Bytes[i] != 0); i++)
+      ;
+   if (i > 0) {
+      Volume->FsLabel = AllocateZeroPool((i + 1) * sizeof(CHAR16));
+      if (Volume->FsLabel != NULL) {
+         Count = Utf8ToUtf16(Bytes, i, Volume->FsLabel, &Valid);
+         Volume->FsLabel[Count] = 0;
+      } // if
+   } // if
+} // VOID SetFilesystemLabel()
+
 // Identify the filesystem type and record the filesystem's UUID/serial number,
-// if possible. Expects a Buffer containing the first few (normally 4096) bytes
-// of the filesystem. Sets the filesystem type code in Volume->FSType and the
-// UUID/serial number in Volume->VolUuid. Note that the UUID value is recognized
-// differently for each filesystem, and is currently supported only for
-// ext2/3/4fs and ReiserFS. If the UUID can't be determined, it's set to 0. Also, the UUID
-// is just read directly into memory; it is *NOT* valid when displayed by
-// GuidAsString() or used in other GUID/UUID-manipulating functions. (As I
-// write, it's being used merely to detect partitions that are part of a
-// RAID 1 array.)
+// label, and size, if possible. Expects a Buffer containing the first few
+// (normally SAMPLE_SIZE) bytes of the filesystem. Sets the filesystem type
+// code in Volume->FSType and the UUID/serial number in Volume->VolUuid. Note
+// that the UUID value is recognized differently for each filesystem, and is
+// currently supported only for ext2/3/4fs, ReiserFS, Btrfs, and XFS. If the
+// UUID can't be determined, it's set to 0. Also, the UUID is just read
+// directly into memory; it is *NOT* valid when displayed by GuidAsString() or
+// used in other GUID/UUID-manipulating functions. (As I write, it's being used
+// merely to detect partitions that are part of a RAID 1 array.)
+// The label is stored in Volume->FsLabel and the size in Volume->FsSize for
+// filesystems that keep them in their superblocks (the HFS+, NTFS, and FAT
+// labels live elsewhere, so those are left for the filesystem driver to
+// report). GetVolumeName() uses these to avoid querying the driver.
 static VOID SetFilesystemData(IN UINT8 *Buffer, IN UINTN BufferSize, IN OUT REFIT_VOLUME *Volume) {
    UINT32       *Ext2Incompat, *Ext2Compat;
+   UINT64       Blocks;
    UINT16       *Magic16;
    char         *MagicString;
 
    if ((Buffer != NULL) && (Volume != NULL)) {
       SetMem(&(Volume->VolUuid), sizeof(EFI_GUID), 0);
       Volume->FSType = FS_TYPE_UNKNOWN;
+      MyFreePool(Volume->FsLabel);
+      Volume->FsLabel = NULL;
+      Volume->FsLabelKnown = FALSE;
+      Volume->FsSize = 0;
 
       if (BufferSize >= 512) {
+         if (CompareMem(Buffer + 3, NTFS_SIGNATURE, 8) == 0) {
+            Volume->FSType = FS_TYPE_NTFS;
+            Volume->FsSize = *((UINT64*) (Buffer + 40)) * *((UINT16*) (Buffer + 11));
+            return;
+         } // if
          Magic16 = (UINT16*) (Buffer + 510);
          if (*Magic16 == FAT_MAGIC) {
             Volume->FSType = FS_TYPE_FAT;
             return;
          } // if
-      } // search for FAT magic
+      } // search for NTFS and FAT magic
 
-      if (BufferSize >= (1024 + 100)) {
+      if (BufferSize >= (1024 + 512)) {
          Magic16 = (UINT16*) (Buffer + 1024 + 56);
          if (*Magic16 == EXT2_SUPER_MAGIC) { // ext2/3/4
             Ext2Compat = (UINT32*) (Buffer + 1024 + 92);
@@ -505,33 +568,56 @@ static VOID SetFilesystemData(IN UINT8 *Buffer, IN UINTN BufferSize, IN OUT REFI
                Volume->FSType = FS_TYPE_EXT2;
             }
             CopyMem(&(Volume->VolUuid), Buffer + 1024 + 104, sizeof(EFI_GUID));
+            Blocks = *((UINT32*) (Buffer + 1024 + 4));
+            if (*Ext2Incompat & 0x0080) // 64-bit block numbers
+               Blocks |= (UINT64) *((UINT32*) (Buffer + 1024 + 336)) << 32;
+            if (*((UINT32*) (Buffer + 1024 + 24)) <= 6) // block size of up to 64 KiB
+               Volume->FsSize = Blocks << (10 + *((UINT32*) (Buffer + 1024 + 24)));
+            SetFilesystemLabel(Volume, Buffer + 1024 + 120, 16);
             return;
          }
       } // search for ext2/3/4 magic
 
-      if (BufferSize >= (65536 + 100)) {
+      if (BufferSize >= 512) {
+         if (CompareMem(Buffer, XFS_SIGNATURE, 4) == 0) {
+            Volume->FSType = FS_TYPE_XFS;
+            CopyMem(&(Volume->VolUuid), Buffer + 32, sizeof(EFI_GUID));
+            Volume->FsSize = BigEndianValue(Buffer + 8, 8) * BigEndianValue(Buffer + 4, 4);
+            SetFilesystemLabel(Volume, Buffer + 108, 12);
+            return;
+         } // if
+      } // search for XFS magic
+
+      if (BufferSize >= (65536 + 116)) {
          MagicString = (char*) (Buffer + 65536 + 52);
          if ((CompareMem(MagicString, REISERFS_SUPER_MAGIC_STRING, 8) == 0) ||
              (CompareMem(MagicString, REISER2FS_SUPER_MAGIC_STRING, 9) == 0) ||
              (CompareMem(MagicString, REISER2FS_JR_SUPER_MAGIC_STRING, 9) == 0)) {
             Volume->FSType = FS_TYPE_REISERFS;
             CopyMem(&(Volume->VolUuid), Buffer + 65536 + 84, sizeof(EFI_GUID));
+            Volume->FsSize = (UINT64) *((UINT32*) (Buffer + 65536)) * *((UINT16*) (Buffer + 65536 + 44));
+            if (CompareMem(MagicString, REISERFS_SUPER_MAGIC_STRING, 8) != 0) // the 3.5 format has no label
+               SetFilesystemLabel(Volume, Buffer + 65536 + 100, 16);
             return;
          } // if
       } // search for ReiserFS magic
 
-      if (BufferSize >= (65536 + 64 + 8)) {
+      if (BufferSize >= (65536 + 0x12b + 256)) {
          MagicString = (char*) (Buffer + 65536 + 64);
          if (CompareMem(MagicString, BTRFS_SIGNATURE, 8) == 0) {
             Volume->FSType = FS_TYPE_BTRFS;
+            CopyMem(&(Volume->VolUuid), Buffer + 65536 + 0x20, sizeof(EFI_GUID));
+            Volume->FsSize = *((UINT64*) (Buffer + 65536 + 0x70));
+            SetFilesystemLabel(Volume, Buffer + 65536 + 0x12b, 256);
             return;
          } // if
       } // search for Btrfs magic
 
-      if (BufferSize >= (1024 + 2)) {
+      if (BufferSize >= (1024 + 48)) {
          Magic16 = (UINT16*) (Buffer + 1024);
          if ((*Magic16 == HFSPLUS_MAGIC1) || (*Magic16 == HFSPLUS_MAGIC2)) {
             Volume->FSType = FS_TYPE_HFSPLUS;
+            Volume->FsSize = BigEndianValue(Buffer + 1024 + 44, 4) * BigEndianValue(Buffer + 1024 + 40, 4);
             return;
          }
       } // search for HFS+ magic
@@ -546,6 +632,7 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
     UINTN                   i;
     MBR_PARTITION_INFO      *MbrTable;
     BOOLEAN                 MbrTableFound = FALSE;
+    UINT32                  Sigs;
 
     Volume->HasBootCode = FALSE;
     Volume->OSIconName = NULL;
@@ -564,7 +651,8 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
     if (!EFI_ERROR(Status)) {
 
         SetFilesystemData(Buffer, SAMPLE_SIZE, Volume);
-        if ((*((UINT16 *)(Buffer + 510)) == 0xaa55 && Buffer[0] != 0) && (FindMem(Buffer, 512, "EXFAT", 5) == -1)) {
+        Sigs = FindBootcodeSignatures(Buffer, SECTOR_SIZE);
+        if ((*((UINT16 *)(Buffer + 510)) == 0xaa55 && Buffer[0] != 0) && !(Sigs & BOOTCODE_SIG_EXFAT)) {
             *Bootable = TRUE;
             Volume->HasBootCode = TRUE;
         }
@@ -573,12 +661,12 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
         if (CompareMem(Buffer + 2, "LILO", 4) == 0 ||
             CompareMem(Buffer + 6, "LILO", 4) == 0 ||
             CompareMem(Buffer + 3, "SYSLINUX", 8) == 0 ||
-            FindMem(Buffer, SECTOR_SIZE, "ISOLINUX", 8) >= 0) {
+            (Sigs & BOOTCODE_SIG_ISOLINUX)) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"linux";
             Volume->OSName = L"Linux";
 
-        } else if (FindMem(Buffer, 512, "Geom\0Hard Disk\0Read\0 Error", 26) >= 0) {   // GRUB
+        } else if (Sigs & BOOTCODE_SIG_GRUB) {   // GRUB
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"grub,linux";
             Volume->OSName = L"Linux";
@@ -595,57 +683,53 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
         } else if ((*((UINT32 *)(Buffer + 502)) == 0 &&
                     *((UINT32 *)(Buffer + 506)) == 50000 &&
                     *((UINT16 *)(Buffer + 510)) == 0xaa55) ||
-                    FindMem(Buffer, SECTOR_SIZE, "Starting the BTX loader", 23) >= 0) {
+                    (Sigs & BOOTCODE_SIG_BTX)) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"freebsd";
             Volume->OSName = L"FreeBSD";
 
-        } else if (FindMem(Buffer, 512, "!Loading", 8) >= 0 ||
-                   FindMem(Buffer, SECTOR_SIZE, "/cdboot\0/CDBOOT\0", 16) >= 0) {
+        } else if (Sigs & (BOOTCODE_SIG_OPENBSD_LOADING | BOOTCODE_SIG_OPENBSD_CDBOOT)) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"openbsd";
             Volume->OSName = L"OpenBSD";
 
-        } else if (FindMem(Buffer, 512, "Not a bootxx image", 18) >= 0 ||
+        } else if ((Sigs & BOOTCODE_SIG_NETBSD) ||
                    *((UINT32 *)(Buffer + 1028)) == 0x7886b6d1) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"netbsd";
             Volume->OSName = L"NetBSD";
 
-        } else if (FindMem(Buffer, SECTOR_SIZE, "NTLDR", 5) >= 0) {
+        } else if (Sigs & BOOTCODE_SIG_NTLDR) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"win";
             Volume->OSName = L"Windows";
 
-        } else if (FindMem(Buffer, SECTOR_SIZE, "BOOTMGR", 7) >= 0) {
+        } else if (Sigs & BOOTCODE_SIG_BOOTMGR) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"winvista,win";
             Volume->OSName = L"Windows";
 
-        } else if (FindMem(Buffer, 512, "CPUBOOT SYS", 11) >= 0 ||
-                   FindMem(Buffer, 512, "KERNEL  SYS", 11) >= 0) {
+        } else if (Sigs & (BOOTCODE_SIG_FREEDOS_CPUBOOT | BOOTCODE_SIG_FREEDOS_KERNEL)) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"freedos";
             Volume->OSName = L"FreeDOS";
 
-        } else if (FindMem(Buffer, 512, "OS2LDR", 6) >= 0 ||
-                   FindMem(Buffer, 512, "OS2BOOT", 7) >= 0) {
+        } else if (Sigs & (BOOTCODE_SIG_OS2LDR | BOOTCODE_SIG_OS2BOOT)) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"ecomstation";
             Volume->OSName = L"eComStation";
 
-        } else if (FindMem(Buffer, 512, "Be Boot Loader", 14) >= 0) {
+        } else if (Sigs & BOOTCODE_SIG_BEOS) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"beos";
             Volume->OSName = L"BeOS";
 
-        } else if (FindMem(Buffer, 512, "yT Boot Loader", 14) >= 0) {
+        } else if (Sigs & BOOTCODE_SIG_ZETA) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"zeta,beos";
             Volume->OSName = L"ZETA";
 
-        } else if (FindMem(Buffer, 512, "\x04" "beos\x06" "system\x05" "zbeos", 18) >= 0 ||
-                   FindMem(Buffer, 512, "\x06" "system\x0c" "haiku_loader", 20) >= 0) {
+        } else if (Sigs & (BOOTCODE_SIG_HAIKU_ZBEOS | BOOTCODE_SIG_HAIKU_LOADER)) {
             Volume->HasBootCode = TRUE;
             Volume->OSIconName = L"haiku,beos";
             Volume->OSName = L"Haiku";
@@ -662,15 +746,15 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
 #endif
 
         // dummy FAT boot sector (created by OS X's newfs_msdos)
-        if (FindMem(Buffer, 512, "Non-system disk", 15) >= 0)
+        if (Sigs & BOOTCODE_SIG_NONSYSTEM_OSX)
             Volume->HasBootCode = FALSE;
 
         // dummy FAT boot sector (created by Linux's mkdosfs)
-        if (FindMem(Buffer, 512, "This is not a bootable disk", 27) >= 0)
+        if (Sigs & BOOTCODE_SIG_NONSYSTEM_LINUX)
             Volume->HasBootCode = FALSE;
 
         // dummy FAT boot sector (created by Windows)
-        if (FindMem(Buffer, 512, "Press any key to restart", 24) >= 0)
+        if (Sigs & BOOTCODE_SIG_NONSYSTEM_WINDOWS)
             Volume->HasBootCode = FALSE;
 
         // check for MBR partition table
@@ -695,11 +779,16 @@ static VOID ScanVolumeBootcode(REFIT_VOLUME *Volume, BOOLEAN *Bootable)
     }
 } /* VOID ScanVolumeBootcode() */
 
-// Set default volume badge icon based on /.VolumeBadge.{icns|png} file or disk kind
-VOID SetVolumeBadgeIcon(REFIT_VOLUME *Volume)
+// Set default volume badge icon based on /.VolumeBadge.{icns|png} file or disk kind.
+// HasCustomBadge says whether FindVolumeIconFiles() found (or couldn't rule out)
+// a .VolumeBadge file, so that volumes known to lack one don't pay for a
+// failed Open() per icon extension.
+// The built-in badges are shared by all volumes of a kind (see BuiltinIcon()).
+VOID SetVolumeBadgeIcon(REFIT_VOLUME *Volume, IN BOOLEAN HasCustomBadge)
 {
-   if (Volume->VolBadgeImage == NULL) {
+   if ((Volume->VolBadgeImage == NULL) && HasCustomBadge) {
       Volume->VolBadgeImage = egLoadIconAnyType(Volume->RootDir, L"", L".VolumeBadge", GlobalConfig.IconSizes[ICON_SIZE_BADGE]);
+      Volume->OwnsBadgeImage = (Volume->VolBadgeImage != NULL);
    }
 
    if (Volume->VolBadgeImage == NULL) {
@@ -747,15 +836,21 @@ static CHAR16 *SizeInIEEEUnits(UINT64 SizeInBytes) {
 // Return a name for the volume. Ideally this should be the label for the
 // filesystem it contains, but this function falls back to describing the
 // filesystem by size (200 MiB, etc.) and/or type (ext2, HFS+, etc.), if
-// this information can be extracted.
+// this information can be extracted. The label and size found in the
+// superblock by SetFilesystemData() are used when available; the filesystem
+// driver is queried only if the superblock didn't hold the label.
 // The calling function is responsible for freeing the memory allocated
 // for the name string.
 static CHAR16 *GetVolumeName(REFIT_VOLUME *Volume) {
    EFI_FILE_SYSTEM_INFO    *FileSystemInfoPtr = NULL;
    CHAR16                  *FoundName = NULL;
    CHAR16                  *SISize, *TypeName;
+   UINT64                  VolumeSize = Volume->FsSize;
 
-   if (Volume->RootDir != NULL) {
+   if (Volume->FsLabelKnown) {
+      if (Volume->FsLabel != NULL)
+         FoundName = StrDuplicate(Volume->FsLabel);
+   } else if (Volume->RootDir != NULL) {
       FileSystemInfoPtr = LibFileSystemInfo(Volume->RootDir);
    }
 
@@ -763,6 +858,8 @@ static CHAR16 *GetVolumeName(REFIT_VOLUME *Volume) {
        (StrLen(FileSystemInfoPtr->VolumeLabel) > 0)) {
       FoundName = StrDuplicate(FileSystemInfoPtr->VolumeLabel);
    }
+   if ((FileSystemInfoPtr != NULL) && (VolumeSize == 0))
+      VolumeSize = FileSystemInfoPtr->VolumeSize;
 
    // Special case: Old versions of the rEFInd HFS+ driver always returns label of "HFS+ volume", so wipe
    // this so that we can build a new name that includes the size....
@@ -778,10 +875,10 @@ static CHAR16 *GetVolumeName(REFIT_VOLUME *Volume) {
    } // if use partition name
 
    // No filesystem or acceptable partition name, so use fs type and size
-   if ((FoundName == NULL) && (FileSystemInfoPtr != NULL)) {
+   if ((FoundName == NULL) && (VolumeSize > 0)) {
       FoundName = AllocateZeroPool(sizeof(CHAR16) * 256);
       if (FoundName != NULL) {
-         SISize = SizeInIEEEUnits(FileSystemInfoPtr->VolumeSize);
+         SISize = SizeInIEEEUnits(VolumeSize);
          SPrint(FoundName, 255, L"%s%s volume", SISize, FSTypeName(Volume->FSType));
          MyFreePool(SISize);
       } // if allocated memory OK
@@ -835,6 +932,7 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
     EFI_HANDLE              WholeDiskHandle;
     UINTN                   PartialLength;
     BOOLEAN                 Bootable;
+    UINTN                   IconFiles;
 
     // get device path
     Volume->DevicePath = DuplicateDevicePath(DevicePathFromHandle(Volume->DeviceHandle));
@@ -942,20 +1040,23 @@ VOID ScanVolume(REFIT_VOLUME *Volume)
     Volume->RootDir = LibOpenRoot(Volume->DeviceHandle);
 
     // Set volume icon based on .VolumeBadge icon or disk kind
-    SetVolumeBadgeIcon(Volume);
+    IconFiles = FindVolumeIconFiles(Volume);
+    SetVolumeBadgeIcon(Volume, (IconFiles & VOLUME_FILE_BADGE) != 0);
 
     Volume->VolName = GetVolumeName(Volume);
 
     if (Volume->RootDir == NULL) {
-        Volume->IsReadable = FALSE;
+        Volume->ProbedReadable = FALSE;
         return;
     } else {
-        Volume->IsReadable = TRUE;
+        Volume->ProbedReadable = TRUE;
     }
 
     // get custom volume icons if present
-    if (!Volume->VolIconImage)
+    if (!Volume->VolIconImage && (IconFiles & VOLUME_FILE_ICON)) {
        Volume->VolIconImage = egLoadIconAnyType(Volume->RootDir, L"", L".VolumeIcon", GlobalConfig.IconSizes[ICON_SIZE_BIG]);
+       Volume->OwnsIconImage = (Volume->VolIconImage != NULL);
+    }
 } // ScanVolume()
 
 static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_INFO *MbrEntry)
@@ -1005,13 +1106,14 @@ static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_I
                 Volume->BlockIO = WholeDiskVolume->BlockIO;
                 Volume->BlockIOOffset = ExtCurrent + EMbrTable[i].StartLBA;
                 Volume->WholeDiskBlockIO = WholeDiskVolume->BlockIO;
+                Volume->IsNew = TRUE;
 
                 Bootable = FALSE;
                 ScanVolumeBootcode(Volume, &Bootable);
                 if (!Bootable)
                     Volume->HasBootCode = FALSE;
 
-                SetVolumeBadgeIcon(Volume);
+                SetVolumeBadgeIcon(Volume, FALSE);
 
                 AddListElement((VOID ***) &Volumes, &VolumesCount, Volume);
 
@@ -1020,41 +1122,132 @@ static VOID ScanExtendedPartition(REFIT_VOLUME *WholeDiskVolume, MBR_PARTITION_I
     }
 } /* VOID ScanExtendedPartition() */
 
+// Returns the volume from OldVolumes (as found by a previous ScanVolumes()
+// call) that resides on DeviceHandle, if its medium hasn't changed since
+// then, and removes it from OldVolumes. Returns NULL if there's no such
+// volume or if it must be scanned again.
+static REFIT_VOLUME * ReuseVolume(IN EFI_HANDLE DeviceHandle, IN OUT REFIT_VOLUME **OldVolumes, IN UINTN OldVolumesCount)
+{
+    EFI_STATUS              Status;
+    EFI_BLOCK_IO            *BlockIO = NULL;
+    VOID                    *FileSystem = NULL;
+    REFIT_VOLUME            *Volume;
+    UINTN                   i;
+
+    for (i = 0; i < OldVolumesCount; i++) {
+        Volume = OldVolumes[i];
+        if ((Volume == NULL) || (Volume->DeviceHandle != DeviceHandle))
+            continue;
+
+        Status = refit_call3_wrapper(BS->HandleProtocol, DeviceHandle, &BlockIoProtocol, (VOID **) &BlockIO);
+        if (EFI_ERROR(Status) || (BlockIO == NULL) || (BlockIO != Volume->BlockIO) ||
+            !BlockIO->Media->MediaPresent || (BlockIO->Media->MediaId != Volume->MediaId)) {
+            return NULL;   // medium changed
+        }
+        // A volume without a filesystem (such as a whole disk) can be kept only if
+        // no filesystem driver has connected to it since the last scan.
+        if (Volume->RootDir == NULL) {
+            Status = refit_call3_wrapper(BS->HandleProtocol, DeviceHandle, &FileSystemProtocol, &FileSystem);
+            if (!EFI_ERROR(Status))
+                return NULL;
+        }
+        OldVolumes[i] = NULL;
+        return Volume;
+    } // for
+    return NULL;
+} // static REFIT_VOLUME * ReuseVolume()
+
+// Free a volume that's no longer present. Only icon and badge images that were
+// loaded from the volume itself are freed; built-in images are shared with
+// other volumes.
+static VOID FreeVolume(IN REFIT_VOLUME *Volume)
+{
+    if (Volume->OwnsIconImage)
+        egFreeImage(Volume->VolIconImage);
+    if (Volume->OwnsBadgeImage)
+        egFreeImage(Volume->VolBadgeImage);
+    if (Volume->RootDir != NULL)
+        refit_call1_wrapper(Volume->RootDir->Close, Volume->RootDir);
+    MyFreePool(Volume->DevicePath);
+    MyFreePool(Volume->WholeDiskDevicePath);
+    MyFreePool(Volume->VolName);
+    MyFreePool(Volume->PartName);
+    MyFreePool(Volume->FsLabel);
+    MyFreePool(Volume->MbrPartitionTable);
+    FreePool(Volume);
+} // static VOID FreeVolume()
+
+// Free every volume found by earlier ScanVolumes() calls, along with the cached
+// partition tables, so that the next call probes every disk afresh. This is
+// needed after the configuration file has been re-read, since icon sizes and
+// the like may have changed.
+VOID FreeVolumes(VOID)
+{
+    UINTN                   VolumeIndex;
+
+    for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
+        // SelfRootDir may be SelfVolume's root directory; leave that open
+        if ((Volumes[VolumeIndex] == SelfVolume) && (SelfRootDir == SelfVolume->RootDir))
+            SelfVolume->RootDir = NULL;
+        FreeVolume(Volumes[VolumeIndex]);
+    }
+    MyFreePool(Volumes);
+    Volumes = NULL;
+    VolumesCount = 0;
+    SelfVolume = NULL;
+    ForgetPartitionTables();
+} // VOID FreeVolumes()
+
+// Build the Volumes list. Volumes found by a previous call whose handles and
+// media are unchanged are kept as they are, so that a rescan reads only the
+// disks that have been added or changed since then; those that were probed
+// afresh have IsNew set.
 VOID ScanVolumes(VOID)
 {
     EFI_STATUS              Status;
     EFI_HANDLE              *Handles;
     REFIT_VOLUME            *Volume, *WholeDiskVolume;
+    REFIT_VOLUME            **OldVolumes, **NewVolumes = NULL;
     MBR_PARTITION_INFO      *MbrTable;
     UINTN                   HandleCount = 0;
     UINTN                   HandleIndex;
     UINTN                   VolumeIndex, VolumeIndex2;
+    UINTN                   OldVolumesCount, NewVolumesCount = 0;
     UINTN                   PartitionIndex;
     UINTN                   SectorSum, i, VolNumber = 0;
     UINT8                   *SectorBuffer1, *SectorBuffer2;
     EFI_GUID                *UuidList;
     EFI_GUID                NullUuid = NULL_GUID_VALUE;
 
-    MyFreePool(Volumes);
+    OldVolumes = Volumes;
+    OldVolumesCount = VolumesCount;
     Volumes = NULL;
     VolumesCount = 0;
-    ForgetPartitionTables();
 
     // get all filesystem handles
     Status = LibLocateHandle(ByProtocol, &BlockIoProtocol, NULL, &HandleCount, &Handles);
-    UuidList = AllocateZeroPool(sizeof(EFI_GUID) * HandleCount);
-    if (Status == EFI_NOT_FOUND) {
-        return;  // no filesystems. strange, but true...
-    }
-    if (CheckError(Status, L"while listing all file systems"))
-        return;
+    if ((Status == EFI_NOT_FOUND) || CheckError(Status, L"while listing all file systems"))
+        HandleCount = 0; // no filesystems. strange, but true...
+    UuidList = AllocateZeroPool(sizeof(EFI_GUID) * (HandleCount + 1));
 
     // first pass: collect information about all handles
     for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
-        Volume = AllocateZeroPool(sizeof(REFIT_VOLUME));
-        Volume->DeviceHandle = Handles[HandleIndex];
-        AddPartitionTable(Volume);
-        ScanVolume(Volume);
+        Volume = ReuseVolume(Handles[HandleIndex], OldVolumes, OldVolumesCount);
+        if (Volume == NULL) {
+            Volume = AllocateZeroPool(sizeof(REFIT_VOLUME));
+            Volume->DeviceHandle = Handles[HandleIndex];
+            AddPartitionTable(Volume);
+            ScanVolume(Volume);
+            if (Volume->BlockIO != NULL)
+                Volume->MediaId = Volume->BlockIO->Media->MediaId;
+            Volume->IsNew = TRUE;
+            AddListElement((VOID ***) &NewVolumes, &NewVolumesCount, Volume);
+        } else {
+            AddPartitionTable(Volume); // keep this disk's GPT, if any
+            Volume->IsNew = FALSE;
+        } // if/else
+        // Duplicate UUIDs are checked on every scan, since the other volume may have gone away
+        Volume->IsReadable = Volume->ProbedReadable;
         if (UuidList) {
            UuidList[HandleIndex] = Volume->VolUuid;
            for (i = 0; i < HandleIndex; i++) {
@@ -1074,14 +1267,42 @@ VOID ScanVolumes(VOID)
         if (Volume->DeviceHandle == SelfLoadedImage->DeviceHandle)
             SelfVolume = Volume;
     }
-    MyFreePool(Handles);
+    if (HandleCount > 0)
+        MyFreePool(Handles);
+    MyFreePool(UuidList);
+    ForgetUnusedPartitionTables();
 
     if (SelfVolume == NULL)
         Print(L"WARNING: SelfVolume not found");
 
-    // second pass: relate partitions and whole disk devices
-    for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-        Volume = Volumes[VolumeIndex];
+    // Logical partitions have no handles of their own; keep those on disks
+    // that were kept, and discard everything else left from the last scan.
+    for (VolumeIndex = 0; VolumeIndex < OldVolumesCount; VolumeIndex++) {
+        Volume = OldVolumes[VolumeIndex];
+        if ((Volume == NULL) || (Volume == SelfVolume))
+            continue;
+        if (Volume->DeviceHandle == NULL) {
+            for (VolumeIndex2 = 0; VolumeIndex2 < VolumesCount; VolumeIndex2++) {
+                if ((Volumes[VolumeIndex2]->BlockIO == Volume->WholeDiskBlockIO) &&
+                    (Volumes[VolumeIndex2]->BlockIOOffset == 0)) {
+                    WholeDiskVolume = Volumes[VolumeIndex2];
+                    break;
+                }
+            } // for
+            if ((VolumeIndex2 < VolumesCount) && (Volume->WholeDiskBlockIO != NULL) &&
+                (WholeDiskVolume->DeviceHandle != NULL) && !WholeDiskVolume->IsNew) {
+                Volume->IsNew = FALSE;
+                AddListElement((VOID ***) &Volumes, &VolumesCount, Volume);
+                continue;
+            }
+        } // if logical partition
+        FreeVolume(Volume);
+    } // for
+    MyFreePool(OldVolumes);
+
+    // second pass: relate new partitions and whole disk devices
+    for (VolumeIndex = 0; VolumeIndex < NewVolumesCount; VolumeIndex++) {
+        Volume = NewVolumes[VolumeIndex];
         // check MBR partition table for extended partitions
         if (Volume->BlockIO != NULL && Volume->WholeDiskBlockIO != NULL &&
             Volume->BlockIO == Volume->WholeDiskBlockIO && Volume->BlockIOOffset == 0 &&
@@ -1151,8 +1372,35 @@ VOID ScanVolumes(VOID)
             MyFreePool(SectorBuffer2);
         }
     } // for
+    MyFreePool(NewVolumes);
 } /* VOID ScanVolumes() */
 
+// Have the firmware signal NewVolumeEvent whenever a BlockIO or filesystem
+// protocol is installed, as happens when the user plugs in a USB flash drive
+// or inserts a CD. The main menu waits on this event so that it can rescan.
+VOID WatchForNewVolumes(VOID) {
+    EFI_STATUS Status;
+
+    if (NewVolumeEvent != NULL)
+        return;
+
+    Status = refit_call5_wrapper(BS->CreateEvent, 0, 0, NULL, NULL, &NewVolumeEvent);
+    if (EFI_ERROR(Status)) {
+        NewVolumeEvent = NULL;
+        return;
+    }
+    refit_call3_wrapper(BS->RegisterProtocolNotify, &BlockIoProtocol, NewVolumeEvent, &BlockIoRegistration);
+    refit_call3_wrapper(BS->RegisterProtocolNotify, &FileSystemProtocol, NewVolumeEvent, &FileSystemRegistration);
+} // VOID WatchForNewVolumes()
+
+// Returns TRUE if NewVolumeEvent has been signalled since the last call, and
+// resets it.
+BOOLEAN NewVolumesAppeared(VOID) {
+    if (NewVolumeEvent == NULL)
+        return FALSE;
+    return (refit_call1_wrapper(BS->CheckEvent, NewVolumeEvent) == EFI_SUCCESS);
+} // BOOLEAN NewVolumesAppeared()
+
 static VOID UninitVolumes(VOID)
 {
     REFIT_VOLUME            *Volume;
@@ -1413,6 +1661,38 @@ EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter)
    return DirIter->LastStatus;
 }
 
+// Return VOLUME_FILE_* flags for the .VolumeBadge and .VolumeIcon files that
+// may be in a volume's root directory, so that callers only try to load the
+// icons that can exist. On FAT, a directory entry holds everything about a
+// file, so listing the root directory once is cheaper than a failed Open() for
+// each name and extension. Elsewhere it isn't: the fsw drivers read an inode
+// for every entry listed, so listing a typical Linux root directory on ext4
+// takes about 23 block reads, against one for the four failed Open() calls.
+// On those filesystems, report both files as possibly present. The root
+// directory's read position is reset after listing it.
+static UINTN FindVolumeIconFiles(IN REFIT_VOLUME *Volume)
+{
+   REFIT_DIR_ITER  DirIter;
+   EFI_FILE_INFO   *DirEntry;
+   UINTN           Found = 0;
+
+   if (Volume->RootDir == NULL)
+      return 0;
+   if (Volume->FSType != FS_TYPE_FAT)
+      return VOLUME_FILE_BADGE | VOLUME_FILE_ICON;
+
+   DirIterOpen(Volume->RootDir, NULL, &DirIter);
+   while (DirIterNext(&DirIter, 2, L".VolumeBadge.*,.VolumeIcon.*", &DirEntry)) {
+      if (MetaiMatch(DirEntry->FileName, L".VolumeBadge.*"))
+         Found |= VOLUME_FILE_BADGE;
+      else
+         Found |= VOLUME_FILE_ICON;
+   } // while
+   DirIterClose(&DirIter);
+   refit_call2_wrapper(Volume->RootDir->SetPosition, Volume->RootDir, 0);
+   return Found;
+} // static UINTN FindVolumeIconFiles()
+
 //
 // file name manipulation
 //
@@ -1474,6 +1754,72 @@ INTN FindMem(IN VOID *Buffer, IN UINTN BufferLength, IN VOID *SearchString, IN U
     return -1;
 }
 
+// Convert Length bytes of UTF-8 text at Source to UTF-16 at Dest, which must
+// have room for Length CHAR16s. Runs of ASCII, which is what nearly all
+// configuration files and filesystem labels hold, are handled eight bytes at
+// a time. Invalid or overlong sequences become U+FFFD and cause *Valid to be
+// set to FALSE.
+// Returns the number of CHAR16s stored in Dest.
+UINTN Utf8ToUtf16(IN UINT8 *Source, IN UINTN Length, OUT CHAR16 *Dest, OUT BOOLEAN *Valid)
+{
+    UINT8   *p = Source, *End = Source + Length;
+    CHAR16  *q = Dest;
+    UINT32  CodePoint, Minimum;
+    UINTN   Extra, i;
+
+    *Valid = TRUE;
+    while (p < End) {
+        if ((((UINTN) p & 7) == 0) && ((UINTN) (End - p) >= 8) &&
+            ((*(UINT64 *) p & 0x8080808080808080ULL) == 0)) {
+            for (i = 0; i < 8; i++)
+                q[i] = p[i];
+            p += 8;
+            q += 8;
+            continue;
+        } // if eight ASCII characters
+
+        CodePoint = *p++;
+        if (CodePoint < 0x80) {
+            *q++ = (CHAR16) CodePoint;
+            continue;
+        } else if ((CodePoint & 0xE0) == 0xC0) {
+            Extra = 1;
+            CodePoint &= 0x1F;
+            Minimum = 0x80;
+        } else if ((CodePoint & 0xF0) == 0xE0) {
+            Extra = 2;
+            CodePoint &= 0x0F;
+            Minimum = 0x800;
+        } else if ((CodePoint & 0xF8) == 0xF0) {
+            Extra = 3;
+            CodePoint &= 0x07;
+            Minimum = 0x10000;
+        } else {
+            Extra = 0;
+            Minimum = 0x110000; // stray continuation byte or invalid lead byte
+        }
+
+        for (i = 0; (i < Extra) && (p + i < End) && ((p[i] & 0xC0) == 0x80); i++)
+            CodePoint = (CodePoint << 6) | (p[i] & 0x3F);
+
+        if ((i < Extra) || (CodePoint < Minimum) || (CodePoint > 0x10FFFF) ||
+            ((CodePoint >= 0xD800) && (CodePoint <= 0xDFFF))) {
+            *q++ = 0xFFFD;
+            *Valid = FALSE;
+        } else if (CodePoint >= 0x10000) {
+            p += Extra;
+            CodePoint -= 0x10000;
+            *q++ = (CHAR16) (0xD800 | (CodePoint >> 10));
+            *q++ = (CHAR16) (0xDC00 | (CodePoint & 0x3FF));
+        } else {
+            p += Extra;
+            *q++ = (CHAR16) CodePoint;
+        }
+    } // while
+
+    return (UINTN) (q - Dest);
+} // UINTN Utf8ToUtf16()
+
 // Performs a case-insensitive search of BigStr for SmallStr.
 // Returns TRUE if found, FALSE if not.
 BOOLEAN StriSubCmp(IN CHAR16 *SmallStr, IN CHAR16 *BigStr) {
@@ -1900,59 +2246,181 @@ BOOLEAN IsIn(IN CHAR16 *SmallString, IN CHAR16 *List) {
       while (!Found && (OneElement = FindCommaDelimited(List, i++))) {
          if (StriCmp(OneElement, SmallString) == 0)
             Found = TRUE;
+         MyFreePool(OneElement);
       } // while
    } // if
    return Found;
 } // BOOLEAN IsIn()
 
-// Returns TRUE if any element of List can be found as a substring of
-// BigString, FALSE otherwise. Performs comparisons case-insensitively.
-BOOLEAN IsInSubstring(IN CHAR16 *BigString, IN CHAR16 *List) {
-   UINTN   i = 0, ElementLength;
-   BOOLEAN Found = FALSE;
-   CHAR16  *OneElement;
+//
+// Hashed name lists
+//
 
-   if (BigString && List) {
-      while (!Found && (OneElement = FindCommaDelimited(List, i++))) {
-         ElementLength = StrLen(OneElement);
-         if ((ElementLength <= StrLen(BigString)) && (StriSubCmp(OneElement, BigString)))
-            Found = TRUE;
-      } // while
-   } // if
-   return Found;
-} // BOOLEAN IsSubstringIn()
-
-// Returns TRUE if specified Volume, Directory, and Filename correspond to an
-// element in the comma-delimited List, FALSE otherwise. Note that Directory and
-// Filename must *NOT* include a volume or path specification (that's part of
-// the Volume variable), but the List elements may. Performs comparison
-// case-insensitively (except on buggy EFIs with case-sensitive StriCmp()
-// functions).
-BOOLEAN FilenameIn(REFIT_VOLUME *Volume, CHAR16 *Directory, CHAR16 *Filename, CHAR16 *List) {
-   UINTN     i = 0;
-   BOOLEAN   Found = FALSE;
-   CHAR16    *OneElement;
-   CHAR16    *TargetVolName = NULL, *TargetPath = NULL, *TargetFilename = NULL;
+// Hash of Name, ignoring the case of ASCII letters. Other characters are
+// skipped, since StriCmp() may or may not fold their case.
+static UINTN HashName(IN CHAR16 *Name) {
+   UINT32 Hash = 2166136261U;
+   CHAR16 c;
 
-   if (Filename && List) {
-      while (!Found && (OneElement = FindCommaDelimited(List, i++))) {
-         Found = TRUE;
-         SplitPathName(OneElement, &TargetVolName, &TargetPath, &TargetFilename);
-         VolumeNumberToName(Volume, &TargetVolName);
-         if (((TargetVolName != NULL) && ((Volume == NULL) || (StriCmp(TargetVolName, Volume->VolName) != 0))) ||
-             ((TargetPath != NULL) && (StriCmp(TargetPath, Directory) != 0)) ||
-             ((TargetFilename != NULL) && (StriCmp(TargetFilename, Filename) != 0))) {
-            Found = FALSE;
-         } // if
+   while ((c = *Name++) != L'\0') {
+      if (c >= 0x80)
+         continue;
+      if ((c >= L'A') && (c <= L'Z'))
+         c += L'a' - L'A';
+      Hash = (Hash ^ c) * 16777619U;
+   } // while
+   return (UINTN) (Hash ^ (Hash >> 16)) & (NAME_LIST_HASH_SIZE - 1);
+} // static UINTN HashName()
+
+// Split the comma-delimited List into NameList, so that later lookups need
+// neither re-parse List nor allocate memory. Kind determines how each element
+// is interpreted:
+//  * NAME_LIST_VOLUMES -- the whole element is a volume or partition name
+//  * NAME_LIST_DIRS -- an optional "volume:" followed by a directory
+//  * NAME_LIST_FILES -- as for SplitPathName()
+// Elements are hashed on their final component; elements that lack that
+// component are kept on a separate list and checked one by one.
+VOID BuildNameList(OUT NAME_LIST *NameList, IN CHAR16 *List, IN UINTN Kind) {
+   UINTN            i = 0, Slot;
+   CHAR16           *OneElement;
+   NAME_LIST_ENTRY  *Entry;
+
+   SetMem(NameList, sizeof(NAME_LIST), 0);
+   NameList->Kind = Kind;
+   while ((OneElement = FindCommaDelimited(List, i++)) != NULL) {
+      Entry = AllocateZeroPool(sizeof(NAME_LIST_ENTRY));
+      if (Entry == NULL) {
          MyFreePool(OneElement);
-      } // while
-   } // if
+         break;
+      }
+      if (Kind == NAME_LIST_VOLUMES) {
+         Entry->VolName = OneElement;
+         Entry->Key = Entry->VolName;
+      } else if (Kind == NAME_LIST_DIRS) {
+         SplitVolumeAndFilename(&OneElement, &(Entry->VolName));
+         CleanUpPathNameSlashes(OneElement);
+         Entry->Path = OneElement;
+         Entry->Key = Entry->Path;
+      } else {
+         SplitPathName(OneElement, &(Entry->VolName), &(Entry->Path), &(Entry->Filename));
+         Entry->Key = Entry->Filename;
+         MyFreePool(OneElement);
+      } // if/else
 
-   MyFreePool(TargetVolName);
-   MyFreePool(TargetPath);
-   MyFreePool(TargetFilename);
-   return Found;
-} // BOOLEAN FilenameIn()
+      // Note any "fs#" volume number, for comparison with REFIT_VOLUME's VolNumber
+      Entry->VolNumber = -1;
+      if ((Kind != NAME_LIST_VOLUMES) && (Entry->VolName != NULL) && (StrLen(Entry->VolName) > 2) &&
+          (Entry->VolName[0] == L'f') && (Entry->VolName[1] == L's') &&
+          (Entry->VolName[2] >= L'0') && (Entry->VolName[2] <= L'9')) {
+         Entry->VolNumber = (INTN) Atoi(Entry->VolName + 2);
+      } // if
+
+      if (Entry->Key != NULL) {
+         Slot = HashName(Entry->Key);
+         Entry->Next = NameList->Buckets[Slot];
+         NameList->Buckets[Slot] = Entry;
+      } else {
+         Entry->Next = NameList->Unhashed;
+         NameList->Unhashed = Entry;
+      } // if/else
+   } // while
+} // VOID BuildNameList()
+
+static VOID FreeNameListEntries(IN NAME_LIST_ENTRY *Entry) {
+   NAME_LIST_ENTRY *Next;
+
+   while (Entry != NULL) {
+      Next = Entry->Next;
+      MyFreePool(Entry->VolName);
+      MyFreePool(Entry->Path);
+      MyFreePool(Entry->Filename);
+      FreePool(Entry);
+      Entry = Next;
+   } // while
+} // static VOID FreeNameListEntries()
+
+VOID FreeNameList(IN OUT NAME_LIST *NameList) {
+   UINTN i;
+
+   for (i = 0; i < NAME_LIST_HASH_SIZE; i++)
+      FreeNameListEntries(NameList->Buckets[i]);
+   FreeNameListEntries(NameList->Unhashed);
+   SetMem(NameList, sizeof(NAME_LIST), 0);
+} // VOID FreeNameList()
+
+// Returns TRUE if Name is an element of the NAME_LIST_VOLUMES list NameList.
+// Performs comparison case-insensitively.
+BOOLEAN NameInList(IN NAME_LIST *NameList, IN CHAR16 *Name) {
+   NAME_LIST_ENTRY *Entry;
+
+   if (Name == NULL)
+      return FALSE;
+   for (Entry = NameList->Buckets[HashName(Name)]; Entry != NULL; Entry = Entry->Next) {
+      if (StriCmp(Entry->Key, Name) == 0)
+         return TRUE;
+   }
+   return FALSE;
+} // BOOLEAN NameInList()
+
+// Returns TRUE if any element of the NAME_LIST_VOLUMES list NameList can be
+// found as a substring of BigString. Performs comparisons case-insensitively.
+BOOLEAN NameListSubstring(IN NAME_LIST *NameList, IN CHAR16 *BigString) {
+   UINTN            i, BigLength;
+   NAME_LIST_ENTRY  *Entry;
+
+   if (BigString == NULL)
+      return FALSE;
+   BigLength = StrLen(BigString);
+   for (i = 0; i < NAME_LIST_HASH_SIZE; i++) {
+      for (Entry = NameList->Buckets[i]; Entry != NULL; Entry = Entry->Next) {
+         if ((StrLen(Entry->Key) <= BigLength) && StriSubCmp(Entry->Key, BigString))
+            return TRUE;
+      }
+   } // for
+   return FALSE;
+} // BOOLEAN NameListSubstring()
+
+// Returns TRUE if Entry's volume, path, and filename components, where
+// present, match Volume, Directory, and Filename.
+static BOOLEAN NameListEntryMatches(IN NAME_LIST_ENTRY *Entry, IN REFIT_VOLUME *Volume,
+                                    IN CHAR16 *Directory, IN CHAR16 *Filename) {
+   if (Entry->VolName != NULL) {
+      if (Volume == NULL)
+         return FALSE;
+      if ((Entry->VolNumber < 0) || ((UINTN) Entry->VolNumber != Volume->VolNumber)) {
+         if ((Volume->VolName == NULL) || (StriCmp(Entry->VolName, Volume->VolName) != 0))
+            return FALSE;
+      }
+   } // if
+   if ((Entry->Path != NULL) && ((Directory == NULL) || (StriCmp(Entry->Path, Directory) != 0)))
+      return FALSE;
+   if ((Entry->Filename != NULL) && ((Filename == NULL) || (StriCmp(Entry->Filename, Filename) != 0)))
+      return FALSE;
+   return TRUE;
+} // static BOOLEAN NameListEntryMatches()
+
+// Returns TRUE if the specified Volume, Directory, and (for NAME_LIST_FILES
+// lists) Filename correspond to an element of NameList, FALSE otherwise. Note
+// that Directory and Filename must *NOT* include a volume or path specification
+// (that's part of the Volume variable), but the list elements may. Performs
+// comparison case-insensitively.
+BOOLEAN PathInNameList(IN NAME_LIST *NameList, IN REFIT_VOLUME *Volume, IN CHAR16 *Directory, IN CHAR16 *Filename) {
+   CHAR16           *Key;
+   NAME_LIST_ENTRY  *Entry;
+
+   Key = (NameList->Kind == NAME_LIST_DIRS) ? Directory : Filename;
+   if (Key == NULL)
+      return FALSE;
+   for (Entry = NameList->Buckets[HashName(Key)]; Entry != NULL; Entry = Entry->Next) {
+      if (NameListEntryMatches(Entry, Volume, Directory, Filename))
+         return TRUE;
+   }
+   for (Entry = NameList->Unhashed; Entry != NULL; Entry = Entry->Next) {
+      if (NameListEntryMatches(Entry, Volume, Directory, Filename))
+         return TRUE;
+   }
+   return FALSE;
+} // BOOLEAN PathInNameList()
 
 // If *VolName is of the form "fs#", where "#" is a number, and if Volume points
 // to this volume number, returns with *VolName changed to the volume name, as
@@ -1965,7 +2433,7 @@ BOOLEAN VolumeNumberToName(REFIT_VOLUME *Volume, CHAR16 **VolName) {
    if ((VolName == NULL) || (*VolName == NULL))
       return FALSE;
 
-   if ((StrLen(*VolName) > 2) && (*VolName[0] == L'f') && (*VolName[1] == L's') && (*VolName[2] >= L'0') && (*VolName[2] <= L'9')) {
+   if ((StrLen(*VolName) > 2) && ((*VolName)[0] == L'f') && ((*VolName)[1] == L's') && ((*VolName)[2] >= L'0') && ((*VolName)[2] <= L'9')) {
       VolNum = Atoi(*VolName + 2);
       if (VolNum == Volume->VolNumber) {
          MyFreePool(*VolName);
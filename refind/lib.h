@@ -78,6 +78,29 @@ typedef struct {
 
 #define IS_EXTENDED_PART_TYPE(type) ((type) == 0x05 || (type) == 0x0f || (type) == 0x85)
 
+// A comma-delimited list, such as GlobalConfig.DontScanFiles, split up and
+// hashed for fast case-insensitive lookups; see BuildNameList()
+#define NAME_LIST_VOLUMES   (0)
+#define NAME_LIST_DIRS      (1)
+#define NAME_LIST_FILES     (2)
+
+#define NAME_LIST_HASH_SIZE (64) /* must be a power of 2 */
+
+typedef struct _name_list_entry {
+    CHAR16                   *VolName;
+    CHAR16                   *Path;
+    CHAR16                   *Filename;
+    CHAR16                   *Key;        // the component on which the entry is hashed
+    INTN                     VolNumber;   // # from an "fs#" VolName, or -1
+    struct _name_list_entry  *Next;
+} NAME_LIST_ENTRY;
+
+typedef struct {
+    UINTN            Kind;
+    NAME_LIST_ENTRY  *Buckets[NAME_LIST_HASH_SIZE];
+    NAME_LIST_ENTRY  *Unhashed;           // entries with no Key
+} NAME_LIST;
+
 // Partition names to be ignored when setting volume name
 #define IGNORE_PARTITION_NAMES L"Microsoft basic data,Linux filesystem,Apple HFS/HFS+"
 
@@ -95,7 +118,10 @@ VOID FreeList(IN OUT VOID ***ListPtr, IN OUT UINTN *ElementCount);
 
 VOID ExtractLegacyLoaderPaths(EFI_DEVICE_PATH **PathList, UINTN MaxPaths, EFI_DEVICE_PATH **HardcodedPathList);
 
+VOID FreeVolumes(VOID);
 VOID ScanVolumes(VOID);
+VOID WatchForNewVolumes(VOID);
+BOOLEAN NewVolumesAppeared(VOID);
 
 BOOLEAN FileExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
 BOOLEAN DirectoryExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath);
@@ -110,6 +136,7 @@ CHAR16 * Basename(IN CHAR16 *Path);
 CHAR16 * StripEfiExtension(CHAR16 *FileName);
 
 INTN FindMem(IN VOID *Buffer, IN UINTN BufferLength, IN VOID *SearchString, IN UINTN SearchStringLength);
+UINTN Utf8ToUtf16(IN UINT8 *Source, IN UINTN Length, OUT CHAR16 *Dest, OUT BOOLEAN *Valid);
 VOID ReinitVolumes(VOID);
 
 BOOLEAN StriSubCmp(IN CHAR16 *TargetStr, IN CHAR16 *BigStr);
@@ -125,9 +152,12 @@ CHAR16 *FindCommaDelimited(IN CHAR16 *InString, IN UINTN Index);
 INTN FindSubString(IN CHAR16 *SmallString, IN CHAR16 *BigString);
 VOID SplitPathName(CHAR16 *InPath, CHAR16 **VolName, CHAR16 **Path, CHAR16 **Filename);
 BOOLEAN IsIn(IN CHAR16 *Filename, IN CHAR16 *List);
-BOOLEAN IsInSubstring(IN CHAR16 *BigString, IN CHAR16 *List);
-BOOLEAN FilenameIn(IN REFIT_VOLUME *Volume, IN CHAR16 *Directory, IN CHAR16 *Filename, IN CHAR16 *List);
 BOOLEAN VolumeNumberToName(REFIT_VOLUME *Volume, CHAR16 **VolName);
+VOID BuildNameList(OUT NAME_LIST *NameList, IN CHAR16 *List, IN UINTN Kind);
+VOID FreeNameList(IN OUT NAME_LIST *NameList);
+BOOLEAN NameInList(IN NAME_LIST *NameList, IN CHAR16 *Name);
+BOOLEAN NameListSubstring(IN NAME_LIST *NameList, IN CHAR16 *BigString);
+BOOLEAN PathInNameList(IN NAME_LIST *NameList, IN REFIT_VOLUME *Volume, IN CHAR16 *Directory, IN CHAR16 *Filename);
 VOID MyFreePool(IN OUT VOID *Pointer);
 
 BOOLEAN EjectMedia(VOID);
@@ -53,6 +53,7 @@
 #include "security_policy.h"
 #include "../include/Handle.h"
 #include "../include/refit_call_wrapper.h"
+#include "../include/FswFileInfo.h"
 #include "driver_support.h"
 #include "../include/syslinux_mbr.h"
 
@@ -71,6 +72,8 @@
 
 #ifdef __MAKEWITH_TIANO
 #define LibLocateHandle gBS->LocateHandleBuffer
+#define BlockIoProtocol gEfiBlockIoProtocolGuid
+#define FileSystemProtocol gEfiSimpleFileSystemProtocolGuid
 #endif
 
 //
@@ -160,8 +163,8 @@ static REFIT_MENU_SCREEN MainMenu       = { L"Main Menu", NULL, 0, NULL, 0, NULL
                                             L"Insert or F2 for more options; Esc to refresh" };
 static REFIT_MENU_SCREEN AboutMenu      = { L"About", NULL, 0, NULL, 0, NULL, 0, NULL, L"Press Enter to return to main menu", L"" };
 
-REFIT_CONFIG GlobalConfig = { FALSE, TRUE, FALSE, 0, 0, 0, DONT_CHANGE_TEXT_MODE, 20, 0, 0, GRAPHICS_FOR_OSX, LEGACY_TYPE_MAC, 0, 0,
-                              { DEFAULT_BIG_ICON_SIZE / 4, DEFAULT_SMALL_ICON_SIZE, DEFAULT_BIG_ICON_SIZE }, BANNER_NOSCALE,
+REFIT_CONFIG GlobalConfig = { FALSE, TRUE, FALSE, FALSE, FALSE, 0, 0, 0, DONT_CHANGE_TEXT_MODE, 20, 0, 0, GRAPHICS_FOR_OSX, LEGACY_TYPE_MAC, 0, 0,
+                              { DEFAULT_BIG_ICON_SIZE / 4, DEFAULT_SMALL_ICON_SIZE, DEFAULT_BIG_ICON_SIZE }, BANNER_NOSCALE, SORT_BY_DATE,
                               NULL, NULL, CONFIG_FILE_NAME, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
                               { TAG_SHELL, TAG_MEMTEST, TAG_GDISK, TAG_APPLE_RECOVERY, TAG_WINDOWS_RECOVERY, TAG_MOK_TOOL,
                                 TAG_ABOUT, TAG_SHUTDOWN, TAG_REBOOT, TAG_FIRMWARE, 0, 0, 0, 0, 0, 0 }
@@ -172,18 +175,55 @@ EFI_GUID RefindGuid = REFIND_GUID_VALUE;
 
 GPT_DATA *gPartitions = NULL;
 
-// Structure used to hold boot loader filenames and time stamps in
+// GlobalConfig.DontScanVolumes, DontScanDirs, and DontScanFiles, split up and
+// hashed by BuildDontScanLists() so that each file or directory can be checked
+// against them quickly
+static NAME_LIST DontScanVolumesList, DontScanDirsList, DontScanFilesList;
+
+// Set while rescanning after a disk has been plugged in, when only the volumes
+// that ScanVolumes() has just probed need to be searched; see RescanNewVolumes().
+static BOOLEAN OnlyNewVolumes = FALSE;
+
+// Structure used to hold boot loader filenames and sort keys in
 // a linked list; used to sort entries within a directory.
 struct LOADER_LIST {
    CHAR16              *FileName;
-   EFI_TIME            TimeStamp;
+   UINT64              SortKey;     // from TimeSortKey() or VersionSortKey(); larger sorts first
+   UINT64              TimeKey;     // from TimeSortKey(); breaks ties between equal SortKeys
    struct LOADER_LIST  *NextEntry;
 };
 
+// Number of version number components packed into a version sort key, and
+// the number of bits given to each one
+#define VERSION_KEY_PARTS (4)
+#define VERSION_KEY_BITS  (16)
+#define VERSION_KEY_MAX   ((1 << VERSION_KEY_BITS) - 1)
+// Field value of a missing component. Pre-release ("-rc") components are
+// stored below it and ordinary numbers above it, so that 4.0.0-rc7 sorts
+// below 4.0.0, which in turn sorts below 4.0.0.1.
+#define VERSION_KEY_ABSENT (0x1000)
+
 //
 // misc functions
 //
 
+// (Re)build the hashed versions of the don't_scan_* lists; must be called
+// whenever the configuration file has been read.
+static VOID BuildDontScanLists(VOID) {
+   FreeNameList(&DontScanVolumesList);
+   FreeNameList(&DontScanDirsList);
+   FreeNameList(&DontScanFilesList);
+   BuildNameList(&DontScanVolumesList, GlobalConfig.DontScanVolumes, NAME_LIST_VOLUMES);
+   BuildNameList(&DontScanDirsList, GlobalConfig.DontScanDirs, NAME_LIST_DIRS);
+   BuildNameList(&DontScanFilesList, GlobalConfig.DontScanFiles, NAME_LIST_FILES);
+} // static VOID BuildDontScanLists()
+
+// Returns TRUE if boot loaders and tools on Volume are to be added to the menu
+// by the current scan.
+static BOOLEAN VolumeNeedsScan(REFIT_VOLUME *Volume) {
+   return (!OnlyNewVolumes || Volume->IsNew);
+} // static BOOLEAN VolumeNeedsScan()
+
 static VOID AboutrEFInd(VOID)
 {
     CHAR16 *FirmwareVendor;
@@ -248,6 +288,22 @@ static VOID WarnSecureBootError(CHAR16 *Name, BOOLEAN Verbose) {
    } // if
 } // VOID WarnSecureBootError()
 
+// Returns TRUE if Header (the first Size bytes of a file) shows it to be a
+// valid EFI loader file of the proper ARCH
+static BOOLEAN IsValidLoaderHeader(CHAR8 *Header, UINTN Size) {
+    BOOLEAN         IsValid = TRUE;
+#if defined (EFIX64) | defined (EFI32)
+    IsValid = Size >= 512 &&
+              ((Header[0] == 'M' && Header[1] == 'Z' &&
+               (Size = *(UINT32 *)&Header[0x3c]) < 0x180 &&
+               Header[Size] == 'P' && Header[Size+1] == 'E' &&
+               Header[Size+2] == 0 && Header[Size+3] == 0 &&
+               *(UINT16 *)&Header[Size+4] == EFI_STUB_ARCH) ||
+              (*(UINT32 *)Header == FAT_ARCH));
+#endif
+    return IsValid;
+} // static BOOLEAN IsValidLoaderHeader()
+
 // Returns TRUE if this file is a valid EFI loader file, and is proper ARCH
 static BOOLEAN IsValidLoader(EFI_FILE *RootDir, CHAR16 *FileName) {
     BOOLEAN         IsValid = TRUE;
@@ -271,14 +327,7 @@ static BOOLEAN IsValidLoader(EFI_FILE *RootDir, CHAR16 *FileName) {
     Status = refit_call3_wrapper(FileHandle->Read, FileHandle, &Size, Header);
     refit_call1_wrapper(FileHandle->Close, FileHandle);
 
-    IsValid = !EFI_ERROR(Status) &&
-              Size == sizeof(Header) &&
-              ((Header[0] == 'M' && Header[1] == 'Z' &&
-               (Size = *(UINT32 *)&Header[0x3c]) < 0x180 &&
-               Header[Size] == 'P' && Header[Size+1] == 'E' &&
-               Header[Size+2] == 0 && Header[Size+3] == 0 &&
-               *(UINT16 *)&Header[Size+4] == EFI_STUB_ARCH) ||
-              (*(UINT32 *)&Header == FAT_ARCH));
+    IsValid = !EFI_ERROR(Status) && IsValidLoaderHeader(Header, Size);
 #endif
     return IsValid;
 } // BOOLEAN IsValidLoader()
@@ -369,6 +418,9 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
     CHAR16                  *FullLoadOptions = NULL;
     CHAR16                  *Filename = NULL;
     CHAR16                  *Temp;
+    UINT8                   *ImageData;
+    UINTN                   ImageSize;
+    BOOLEAN                 IsValid;
 
     if (ErrorInStep != NULL)
         *ErrorInStep = 0;
@@ -400,10 +452,25 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
     ReturnStatus = Status = EFI_NOT_FOUND;  // in case the list is empty
     for (DevicePathIndex = 0; DevicePaths[DevicePathIndex] != NULL; DevicePathIndex++) {
        FindVolumeAndFilename(DevicePaths[DevicePathIndex], &Volume, &Filename);
+       // Read the whole binary just once, if possible. It's then checked, authenticated,
+       // and loaded from memory, rather than being read again by the firmware and by
+       // our Secure Boot hook.
+       ImageData = NULL;
+       ImageSize = 0;
+       if ((LoaderType != TYPE_LEGACY) && (Volume != NULL) && (Volume->RootDir != NULL) && (Filename != NULL)) {
+          if (EFI_ERROR(egLoadFile(Volume->RootDir, Filename, &ImageData, &ImageSize)))
+             ImageData = NULL;
+       }
        // Some EFIs crash if attempting to load driver for invalid architecture, so
        // protect for this condition; but sometimes Volume comes back NULL, so provide
        // an exception. (TODO: Handle this special condition better.)
-       if ((LoaderType == TYPE_LEGACY) || (Volume == NULL) || IsValidLoader(Volume->RootDir, Filename)) {
+       if ((LoaderType == TYPE_LEGACY) || (Volume == NULL))
+          IsValid = TRUE;
+       else if (ImageData != NULL)
+          IsValid = IsValidLoaderHeader((CHAR8 *) ImageData, ImageSize);
+       else
+          IsValid = IsValidLoader(Volume->RootDir, Filename);
+       if (IsValid) {
           if (Filename && (LoaderType != TYPE_LEGACY)) {
              Temp = PoolPrint(L"\\%s %s", Filename, FullLoadOptions ? FullLoadOptions : L"");
              if (Temp != NULL) {
@@ -412,19 +479,27 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
              }
           } // if (Filename)
 
-          // NOTE: Below commented-out line could be more efficient if file were read ahead of
-          // time and passed as a pre-loaded image to LoadImage(), but it doesn't work on my
-          // 32-bit Mac Mini or my 64-bit Intel box when launching a Linux kernel; the
-          // kernel returns a "Failed to handle fs_proto" error message.
-          // TODO: Track down the cause of this error and fix it, if possible.
-          // ReturnStatus = Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
-          //                                            ImageData, ImageSize, &ChildImageHandle);
-          ReturnStatus = Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
-                                                      NULL, 0, &ChildImageHandle);
+          // The device path is passed along with the pre-loaded image, so that the image's
+          // DeviceHandle still points to its filesystem (Linux's EFI stub needs that to load
+          // its initrd; see also the DeviceHandle fix-up below). If the firmware won't load
+          // from memory for some reason other than Secure Boot, let it read the file itself.
+          Status = EFI_UNSUPPORTED;
+          if (ImageData != NULL) {
+             security_policy_set_image(DevicePaths[DevicePathIndex], ImageData, ImageSize);
+             Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
+                                          ImageData, ImageSize, &ChildImageHandle);
+             security_policy_set_image(NULL, NULL, 0);
+          }
+          if (EFI_ERROR(Status) && (Status != EFI_ACCESS_DENIED) && (Status != EFI_SECURITY_VIOLATION)) {
+             Status = refit_call6_wrapper(BS->LoadImage, FALSE, SelfImageHandle, DevicePaths[DevicePathIndex],
+                                          NULL, 0, &ChildImageHandle);
+          }
+          ReturnStatus = Status;
        } else {
           Print(L"Invalid loader file!\n");
           ReturnStatus = EFI_LOAD_ERROR;
        }
+       MyFreePool(ImageData);
        if (ReturnStatus != EFI_NOT_FOUND) {
           break;
        }
@@ -447,6 +522,11 @@ static EFI_STATUS StartEFIImageList(IN EFI_DEVICE_PATH **DevicePaths,
           *ErrorInStep = 2;
        goto bailout_unload;
     }
+    // Some firmware leaves DeviceHandle NULL for images loaded from memory, which
+    // breaks loaders (such as Linux's EFI stub) that read more files from their
+    // own volume.
+    if ((ChildLoadedImage->DeviceHandle == NULL) && (Volume != NULL))
+       ChildLoadedImage->DeviceHandle = Volume->DeviceHandle;
     ChildLoadedImage->LoadOptions = (VOID *)FullLoadOptions;
     ChildLoadedImage->LoadOptionsSize = FullLoadOptions ? ((UINT32)StrLen(FullLoadOptions) + 1) * sizeof(CHAR16) : 0;
     // turn control over to the image
@@ -685,6 +765,7 @@ LOADER_ENTRY *InitializeLoaderEntry(IN LOADER_ENTRY *Entry) {
          NewEntry->UseGraphicsMode = Entry->UseGraphicsMode;
          NewEntry->LoadOptions     = (Entry->LoadOptions) ? StrDuplicate(Entry->LoadOptions) : NULL;
          NewEntry->InitrdPath      = (Entry->InitrdPath) ? StrDuplicate(Entry->InitrdPath) : NULL;
+         NewEntry->Volume          = Entry->Volume;
       }
    } // if
    return (NewEntry);
@@ -754,9 +835,8 @@ VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume) {
    LOADER_ENTRY       *SubEntry;
    CHAR16             *InitrdName;
    CHAR16             DiagsFileName[256];
-   REFIT_FILE         *File;
-   UINTN              TokenCount;
-   CHAR16             **TokenList;
+   LINUX_OPTIONS      *LinuxOptions;
+   UINTN              i;
 
    // create the submenu
    if (StrLen(Entry->Title) == 0) {
@@ -846,29 +926,25 @@ VOID GenerateSubScreen(LOADER_ENTRY *Entry, IN REFIT_VOLUME *Volume) {
       } // if diagnostics entry found
 
    } else if (Entry->OSType == 'L') {   // entries for Linux kernels with EFI stub loaders
-      File = ReadLinuxOptionsFile(Entry->LoaderPath, Volume);
-      if (File != NULL) {
+      LinuxOptions = GetLinuxOptions(Entry->LoaderPath, Volume);
+      if (LinuxOptions != NULL) {
          InitrdName =  FindInitrd(Entry->LoaderPath, Volume);
-         TokenCount = ReadTokenLine(File, &TokenList);
          // first entry requires special processing, since it was initially set
          // up with a default title but correct options by InitializeSubScreen(),
          // earlier....
          if ((SubScreen->Entries != NULL) && (SubScreen->Entries[0] != NULL)) {
             MyFreePool(SubScreen->Entries[0]->Title);
-            SubScreen->Entries[0]->Title = TokenList[0] ? StrDuplicate(TokenList[0]) : StrDuplicate(L"Boot Linux");
+            SubScreen->Entries[0]->Title = StrDuplicate(LinuxOptions->Titles[0]);
          } // if
-         FreeTokenLine(&TokenList, &TokenCount);
-         while ((TokenCount = ReadTokenLine(File, &TokenList)) > 1) {
+         for (i = 1; (i < LinuxOptions->LineCount) && (LinuxOptions->Options[i] != NULL); i++) {
             SubEntry = InitializeLoaderEntry(Entry);
-            SubEntry->me.Title = TokenList[0] ? StrDuplicate(TokenList[0]) : StrDuplicate(L"Boot Linux");
+            SubEntry->me.Title = StrDuplicate(LinuxOptions->Titles[i]);
             MyFreePool(SubEntry->LoadOptions);
-            SubEntry->LoadOptions = AddInitrdToOptions(TokenList[1], InitrdName);
-            FreeTokenLine(&TokenList, &TokenCount);
+            SubEntry->LoadOptions = AddInitrdToOptions(LinuxOptions->Options[i], InitrdName);
             SubEntry->UseGraphicsMode = GlobalConfig.GraphicsFor & GRAPHICS_FOR_LINUX;
             AddMenuEntry(SubScreen, (REFIT_MENU_ENTRY *)SubEntry);
-         } // while
+         } // for
          MyFreePool(InitrdName);
-         MyFreePool(File);
       } // if
 
    } else if (Entry->OSType == 'E') {   // entries for ELILO
@@ -976,7 +1052,7 @@ static VOID GuessLinuxDistribution(CHAR16 **OSIconName, REFIT_VOLUME *Volume, CH
          } // if
          FreeTokenLine(&TokenList, &TokenCount);
       } while (TokenCount > 0);
-      MyFreePool(File.Buffer);
+      FreeRefitFile(&File);
    } // if
 
    // Search for clues in the kernel's filename....
@@ -1117,6 +1193,7 @@ LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN
       }
       MergeStrings(&(Entry->LoaderPath), LoaderPath, 0);
       Entry->VolName = Volume->VolName;
+      Entry->Volume = Volume;
       Entry->DevicePath = FileDevicePath(Volume->DeviceHandle, Entry->LoaderPath);
       SetLoaderDefaults(Entry, LoaderPath, Volume);
       GenerateSubScreen(Entry, Volume);
@@ -1126,49 +1203,95 @@ LOADER_ENTRY * AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderTitle, IN
    return(Entry);
 } // LOADER_ENTRY * AddLoaderEntry()
 
-// Returns -1 if (Time1 < Time2), +1 if (Time1 > Time2), or 0 if
-// (Time1 == Time2). Precision is only to the nearest second; since
-// this is used for sorting boot loader entries, differences smaller
-// than this are likely to be meaningless (and unlikely!).
-INTN TimeComp(IN EFI_TIME *Time1, IN EFI_TIME *Time2) {
-   INT64 Time1InSeconds, Time2InSeconds;
-
+// Returns a value that orders time stamps by date. Precision is only to the
+// nearest second; since this is used for sorting boot loader entries,
+// differences smaller than this are likely to be meaningless (and unlikely!).
+static UINT64 TimeSortKey(IN EFI_TIME *Time) {
    // Following values are overestimates; I'm assuming 31 days in every month.
    // This is fine for the purpose of this function, which is limited
-   Time1InSeconds = Time1->Second + (Time1->Minute * 60) + (Time1->Hour * 3600) + (Time1->Day * 86400) +
-                    (Time1->Month * 2678400) + ((Time1->Year - 1998) * 32140800);
-   Time2InSeconds = Time2->Second + (Time2->Minute * 60) + (Time2->Hour * 3600) + (Time2->Day * 86400) +
-                    (Time2->Month * 2678400) + ((Time2->Year - 1998) * 32140800);
-   if (Time1InSeconds < Time2InSeconds)
-      return (-1);
-   else if (Time1InSeconds > Time2InSeconds)
-      return (1);
-
-   return 0;
-} // INTN TimeComp()
-
-// Adds a loader list element, keeping it sorted by date. Returns the new
-// first element (the one with the most recent date).
-static struct LOADER_LIST * AddLoaderListEntry(struct LOADER_LIST *LoaderList, struct LOADER_LIST *NewEntry) {
-   struct LOADER_LIST *LatestEntry, *CurrentEntry, *PrevEntry = NULL;
-
-   LatestEntry = CurrentEntry = LoaderList;
-   if (LoaderList == NULL) {
-      LatestEntry = NewEntry;
-   } else {
-      while ((CurrentEntry != NULL) && (TimeComp(&(NewEntry->TimeStamp), &(CurrentEntry->TimeStamp)) < 0)) {
-         PrevEntry = CurrentEntry;
-         CurrentEntry = CurrentEntry->NextEntry;
-      } // while
-      NewEntry->NextEntry = CurrentEntry;
-      if (PrevEntry == NULL) {
-         LatestEntry = NewEntry;
+   return (UINT64) Time->Second + (Time->Minute * 60) + (Time->Hour * 3600) + (Time->Day * 86400) +
+          ((UINT64) Time->Month * 2678400) + ((UINT64) Time->Year * 32140800);
+} // static UINT64 TimeSortKey()
+
+// Returns a value that orders file names by the version number they contain,
+// as located by FindNumbers(). Each run of digits is one component, and the
+// first VERSION_KEY_PARTS components fill successive VERSION_KEY_BITS-bit
+// fields, so that (for instance) vmlinuz-3.13.10 sorts above vmlinuz-3.13.6
+// and vmlinuz-3.2.0. A run of digits right after "rc" is a release candidate
+// number and sorts below the release itself (see VERSION_KEY_ABSENT). Names
+// without digits sort last.
+static UINT64 VersionSortKey(IN CHAR16 *FileName) {
+   CHAR16   *Numbers, *p;
+   UINT64   Key = 0, Part;
+   UINTN    Parts = 0;
+   BOOLEAN  PreRelease;
+
+   Numbers = FindNumbers(FileName);
+   p = Numbers;
+   while ((p != NULL) && (*p != L'\0') && (Parts < VERSION_KEY_PARTS)) {
+      if ((*p >= L'0') && (*p <= L'9')) {
+         PreRelease = ((p - Numbers >= 2) && ((p[-2] == L'r') || (p[-2] == L'R')) &&
+                       ((p[-1] == L'c') || (p[-1] == L'C')));
+         Part = 0;
+         while ((*p >= L'0') && (*p <= L'9')) {
+            if (Part < VERSION_KEY_MAX)
+               Part = Part * 10 + (*p - L'0');
+            p++;
+         } // while
+         if (PreRelease)
+            Part = (Part < VERSION_KEY_ABSENT) ? Part : VERSION_KEY_ABSENT - 1;
+         else
+            Part = (Part < VERSION_KEY_MAX - VERSION_KEY_ABSENT) ? Part + VERSION_KEY_ABSENT + 1 : VERSION_KEY_MAX;
+         Key = (Key << VERSION_KEY_BITS) | Part;
+         Parts++;
       } else {
-         PrevEntry->NextEntry = NewEntry;
+         p++;
       } // if/else
-   } // if/else
-   return (LatestEntry);
-} // static VOID AddLoaderListEntry()
+   } // while
+   MyFreePool(Numbers);
+
+   // left-align the components, so that 3.13 sorts above 3.2.1
+   while (Parts++ < VERSION_KEY_PARTS)
+      Key = (Key << VERSION_KEY_BITS) | VERSION_KEY_ABSENT;
+   return Key;
+} // static UINT64 VersionSortKey()
+
+// Sort a loader list in descending order by SortKey and then TimeKey, using a
+// stable merge sort.
+// Returns the new first element.
+static struct LOADER_LIST * SortLoaderList(struct LOADER_LIST *LoaderList) {
+   struct LOADER_LIST *Slow, *Fast, *Second, *Sorted = NULL, **Tail = &Sorted;
+
+   if ((LoaderList == NULL) || (LoaderList->NextEntry == NULL))
+      return LoaderList;
+
+   // split the list in two halves and sort each one....
+   Slow = LoaderList;
+   Fast = LoaderList->NextEntry;
+   while ((Fast != NULL) && (Fast->NextEntry != NULL)) {
+      Slow = Slow->NextEntry;
+      Fast = Fast->NextEntry->NextEntry;
+   } // while
+   Second = Slow->NextEntry;
+   Slow->NextEntry = NULL;
+   LoaderList = SortLoaderList(LoaderList);
+   Second = SortLoaderList(Second);
+
+   // ....then merge them, preferring the first half on ties to keep the sort stable
+   while ((LoaderList != NULL) && (Second != NULL)) {
+      if ((LoaderList->SortKey > Second->SortKey) ||
+          ((LoaderList->SortKey == Second->SortKey) && (LoaderList->TimeKey >= Second->TimeKey))) {
+         *Tail = LoaderList;
+         LoaderList = LoaderList->NextEntry;
+      } else {
+         *Tail = Second;
+         Second = Second->NextEntry;
+      } // if/else
+      Tail = &((*Tail)->NextEntry);
+   } // while
+   *Tail = (LoaderList != NULL) ? LoaderList : Second;
+   return Sorted;
+} // static struct LOADER_LIST * SortLoaderList()
 
 // Delete the LOADER_LIST linked list
 static VOID CleanUpLoaderList(struct LOADER_LIST *LoaderList) {
@@ -1188,11 +1311,10 @@ static VOID CleanUpLoaderList(struct LOADER_LIST *LoaderList) {
 // Returns TRUE if none of these conditions is met -- that is, if the path is
 // eligible for scanning.
 static BOOLEAN ShouldScan(REFIT_VOLUME *Volume, CHAR16 *Path) {
-   CHAR16   *VolName = NULL, *DontScanDir, *PathCopy = NULL;
-   UINTN    i = 0;
+   CHAR16   *VolName = NULL, *PathCopy = NULL;
    BOOLEAN  ScanIt = TRUE;
 
-   if ((IsIn(Volume->VolName, GlobalConfig.DontScanVolumes)) || (IsIn(Volume->PartName, GlobalConfig.DontScanVolumes)))
+   if (NameInList(&DontScanVolumesList, Volume->VolName) || NameInList(&DontScanVolumesList, Volume->PartName))
       return FALSE;
 
    if ((StriCmp(Path, SelfDirPath) == 0) && (Volume->DeviceHandle == SelfVolume->DeviceHandle))
@@ -1211,22 +1333,8 @@ static BOOLEAN ShouldScan(REFIT_VOLUME *Volume, CHAR16 *Path) {
    VolName = NULL;
 
    // See if Volume is in GlobalConfig.DontScanDirs....
-   while (ScanIt && (DontScanDir = FindCommaDelimited(GlobalConfig.DontScanDirs, i++))) {
-      SplitVolumeAndFilename(&DontScanDir, &VolName);
-      CleanUpPathNameSlashes(DontScanDir);
-      VolumeNumberToName(Volume, &VolName);
-      if (VolName != NULL) {
-         if ((StriCmp(VolName, Volume->VolName) == 0) && (StriCmp(DontScanDir, Path) == 0))
-            ScanIt = FALSE;
-      } else {
-         if (StriCmp(DontScanDir, Path) == 0)
-            ScanIt = FALSE;
-      }
-      MyFreePool(DontScanDir);
-      MyFreePool(VolName);
-      DontScanDir = NULL;
-      VolName = NULL;
-   } // while()
+   if (ScanIt && PathInNameList(&DontScanDirsList, Volume, Path, NULL))
+      ScanIt = FALSE;
 
    return ScanIt;
 } // BOOLEAN ShouldScan()
@@ -1294,14 +1402,17 @@ static BOOLEAN DuplicatesFallback(IN REFIT_VOLUME *Volume, IN CHAR16 *FileName)
    return AreIdentical;
 } // BOOLEAN DuplicatesFallback()
 
-// Returns FALSE if two measures of file size are identical for a single file,
-// TRUE if not or if the file can't be opened and the other measure is non-0.
-// Despite the function's name, this isn't really a direct test of symbolic
-// link status, since EFI doesn't officially support symlinks. It does seem
-// to be a reliable indicator, though. (OTOH, some disk errors might cause a
-// file to fail to open, which would return a false positive -- but as I use
-// this function to exclude symbolic links from the list of boot loaders,
-// that would be fine, since such boot loaders wouldn't work.)
+// Returns TRUE if DirEntry appears to be a symbolic link, FALSE if not.
+// rEFInd's own filesystem drivers flag symbolic links in the directory entry
+// itself (see include/FswFileInfo.h), so those need no further I/O, and FAT
+// has no symbolic links at all. For other drivers, fall back on comparing
+// two measures of file size: the directory entry gives the size of the link,
+// whereas opening the file follows it. This isn't really a direct test of
+// symbolic link status, since EFI doesn't officially support symlinks, but
+// it does seem to be a reliable indicator. (OTOH, some disk errors might
+// cause a file to fail to open, which would return a false positive -- but
+// as I use this function to exclude symbolic links from the list of boot
+// loaders, that would be fine, since such boot loaders wouldn't work.)
 static BOOLEAN IsSymbolicLink(REFIT_VOLUME *Volume, CHAR16 *Path, EFI_FILE_INFO *DirEntry) {
    EFI_FILE_HANDLE FileHandle;
    EFI_FILE_INFO   *FileInfo = NULL;
@@ -1309,6 +1420,11 @@ static BOOLEAN IsSymbolicLink(REFIT_VOLUME *Volume, CHAR16 *Path, EFI_FILE_INFO
    UINTN           FileSize2 = 0;
    CHAR16          *FileName;
 
+   if (DirEntry->Attribute & EFI_FILE_FSW_TYPE_VALID)
+      return ((DirEntry->Attribute & EFI_FILE_FSW_SYMLINK) != 0);
+   if (Volume->FSType == FS_TYPE_FAT)
+      return FALSE;
+
    FileName = StrDuplicate(Path);
    MergeStrings(&FileName, DirEntry->FileName, L'\\');
    CleanUpPathNameSlashes(FileName);
@@ -1318,6 +1434,7 @@ static BOOLEAN IsSymbolicLink(REFIT_VOLUME *Volume, CHAR16 *Path, EFI_FILE_INFO
       FileInfo = LibFileInfo(FileHandle);
       if (FileInfo != NULL)
          FileSize2 = FileInfo->FileSize;
+      refit_call1_wrapper(FileHandle->Close, FileHandle);
    }
 
    MyFreePool(FileName);
@@ -1352,7 +1469,8 @@ static BOOLEAN HasSignedCounterpart(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN
 // Scan an individual directory for EFI boot loader files and, if found,
 // add them to the list. Exception: Ignores FALLBACK_FULLNAME, which is picked
 // up in ScanEfiFiles(). Sorts the entries within the loader directory so that
-// the most recent one appears first in the list.
+// the most recent one (or, with "sort_by version", the one with the highest
+// version number) appears first in the list.
 // Returns TRUE if a duplicate for FALLBACK_FILENAME was found, FALSE if not.
 static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16 *Pattern)
 {
@@ -1376,7 +1494,7 @@ static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16
               StriSubCmp(L"shell", DirEntry->FileName) ||
               IsSymbolicLink(Volume, Path, DirEntry) || /* is symbolic link */
               HasSignedCounterpart(Volume, Path, DirEntry->FileName) || /* a file with same name plus ".efi.signed" is present */
-              FilenameIn(Volume, Path, DirEntry->FileName, GlobalConfig.DontScanFiles))
+              PathInNameList(&DontScanFilesList, Volume, Path, DirEntry->FileName))
                 continue;   // skip this
 
           if (Path)
@@ -1391,14 +1509,22 @@ static BOOLEAN ScanLoaderDir(IN REFIT_VOLUME *Volume, IN CHAR16 *Path, IN CHAR16
           NewLoader = AllocateZeroPool(sizeof(struct LOADER_LIST));
           if (NewLoader != NULL) {
              NewLoader->FileName = StrDuplicate(FileName);
-             NewLoader->TimeStamp = DirEntry->ModificationTime;
-             LoaderList = AddLoaderListEntry(LoaderList, NewLoader);
+             NewLoader->TimeKey = TimeSortKey(&(DirEntry->ModificationTime));
+             if (GlobalConfig.SortBy == SORT_BY_VERSION)
+                NewLoader->SortKey = VersionSortKey(DirEntry->FileName);
+             else
+                NewLoader->SortKey = NewLoader->TimeKey;
+             // Prepend; SortLoaderList() is stable, so entries with equal keys
+             // and times end up newest-scanned first, as they always have.
+             NewLoader->NextEntry = LoaderList;
+             LoaderList = NewLoader;
              if (DuplicatesFallback(Volume, FileName))
                 FoundFallbackDuplicate = TRUE;
           } // if
           MyFreePool(Extension);
        } // while
 
+       LoaderList = SortLoaderList(LoaderList);
        NewLoader = LoaderList;
        while (NewLoader != NULL) {
           AddLoaderEntry(NewLoader->FileName, NULL, Volume);
@@ -1440,7 +1566,7 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
       // check for Mac OS X boot loader
       if (ShouldScan(Volume, L"System\\Library\\CoreServices")) {
          StrCpy(FileName, MACOSX_LOADER_PATH);
-         if (FileExists(Volume->RootDir, FileName) && !FilenameIn(Volume, Directory, L"boot.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) && !PathInNameList(&DontScanFilesList, Volume, Directory, L"boot.efi")) {
             AddLoaderEntry(FileName, L"Mac OS X", Volume);
             if (DuplicatesFallback(Volume, FileName))
                ScanFallbackLoader = FALSE;
@@ -1448,7 +1574,7 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
 
          // check for XOM
          StrCpy(FileName, L"System\\Library\\CoreServices\\xom.efi");
-         if (FileExists(Volume->RootDir, FileName) && !FilenameIn(Volume, Directory, L"boot.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) && !PathInNameList(&DontScanFilesList, Volume, Directory, L"boot.efi")) {
             AddLoaderEntry(FileName, L"Windows XP (XoM)", Volume);
             if (DuplicatesFallback(Volume, FileName))
                ScanFallbackLoader = FALSE;
@@ -1458,15 +1584,14 @@ static VOID ScanEfiFiles(REFIT_VOLUME *Volume) {
       // check for Microsoft boot loader/menu
       if (ShouldScan(Volume, L"EFI\\Microsoft\\Boot")) {
          StrCpy(FileName, L"EFI\\Microsoft\\Boot\\bkpbootmgfw.efi");
-         if (FileExists(Volume->RootDir, FileName) &&  !FilenameIn(Volume, Directory, L"bkpbootmgfw.efi",
-             GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) &&  !PathInNameList(&DontScanFilesList, Volume, Directory, L"bkpbootmgfw.efi")) {
             AddLoaderEntry(FileName, L"Microsoft EFI boot (Boot Repair backup)", Volume);
             FoundBRBackup = TRUE;
             if (DuplicatesFallback(Volume, FileName))
                ScanFallbackLoader = FALSE;
          }
          StrCpy(FileName, L"EFI\\Microsoft\\Boot\\bootmgfw.efi");
-         if (FileExists(Volume->RootDir, FileName) &&  !FilenameIn(Volume, Directory, L"bootmgfw.efi", GlobalConfig.DontScanFiles)) {
+         if (FileExists(Volume->RootDir, FileName) &&  !PathInNameList(&DontScanFilesList, Volume, Directory, L"bootmgfw.efi")) {
             if (FoundBRBackup)
                AddLoaderEntry(FileName, L"Supposed Microsoft EFI boot (probably GRUB)", Volume);
             else
@@ -1525,7 +1650,7 @@ static VOID ScanInternal(VOID) {
    UINTN                   VolumeIndex;
 
    for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-      if (Volumes[VolumeIndex]->DiskKind == DISK_KIND_INTERNAL) {
+      if ((Volumes[VolumeIndex]->DiskKind == DISK_KIND_INTERNAL) && VolumeNeedsScan(Volumes[VolumeIndex])) {
          ScanEfiFiles(Volumes[VolumeIndex]);
       }
    } // for
@@ -1536,7 +1661,7 @@ static VOID ScanExternal(VOID) {
    UINTN                   VolumeIndex;
 
    for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-      if (Volumes[VolumeIndex]->DiskKind == DISK_KIND_EXTERNAL) {
+      if ((Volumes[VolumeIndex]->DiskKind == DISK_KIND_EXTERNAL) && VolumeNeedsScan(Volumes[VolumeIndex])) {
          ScanEfiFiles(Volumes[VolumeIndex]);
       }
    } // for
@@ -1547,7 +1672,7 @@ static VOID ScanOptical(VOID) {
    UINTN                   VolumeIndex;
 
    for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-      if (Volumes[VolumeIndex]->DiskKind == DISK_KIND_OPTICAL) {
+      if ((Volumes[VolumeIndex]->DiskKind == DISK_KIND_OPTICAL) && VolumeNeedsScan(Volumes[VolumeIndex])) {
          ScanEfiFiles(Volumes[VolumeIndex]);
       }
    } // for
@@ -1784,7 +1909,7 @@ static LEGACY_ENTRY * AddLegacyEntry(IN CHAR16 *LoaderTitle, IN REFIT_VOLUME *Vo
     LegacyTitle = AllocateZeroPool(256 * sizeof(CHAR16));
     if (LegacyTitle != NULL)
        SPrint(LegacyTitle, 255, L"Boot %s from %s", LoaderTitle, VolDesc);
-    if (IsInSubstring(LegacyTitle, GlobalConfig.DontScanVolumes)) {
+    if (NameListSubstring(&DontScanVolumesList, LegacyTitle)) {
        MyFreePool(LegacyTitle);
        return NULL;
     } // if
@@ -1858,7 +1983,7 @@ static LEGACY_ENTRY * AddLegacyEntryUEFI(BDS_COMMON_OPTION *BdsOption, IN UINT16
     CHAR16                  ShortcutLetter = 0;
     CHAR16 *LegacyDescription = StrDuplicate(BdsOption->Description);
 
-    if (IsInSubstring(LegacyDescription, GlobalConfig.DontScanVolumes))
+    if (NameListSubstring(&DontScanVolumesList, LegacyDescription))
        return NULL;
 
     // Remove stray spaces, since many EFIs produce descriptions with lots of
@@ -2022,10 +2147,10 @@ static VOID ScanLegacyDisc(VOID)
    if (GlobalConfig.LegacyType == LEGACY_TYPE_MAC) {
       for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
          Volume = Volumes[VolumeIndex];
-         if (Volume->DiskKind == DISK_KIND_OPTICAL)
+         if ((Volume->DiskKind == DISK_KIND_OPTICAL) && VolumeNeedsScan(Volume))
             ScanLegacyVolume(Volume, VolumeIndex);
       } // for
-   } else if (GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) {
+   } else if ((GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) && !OnlyNewVolumes) {
       ScanLegacyUEFI(BBS_CDROM);
    }
 } /* static VOID ScanLegacyDisc() */
@@ -2040,10 +2165,10 @@ static VOID ScanLegacyInternal(VOID)
     if (GlobalConfig.LegacyType == LEGACY_TYPE_MAC) {
        for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
            Volume = Volumes[VolumeIndex];
-           if (Volume->DiskKind == DISK_KIND_INTERNAL)
+           if ((Volume->DiskKind == DISK_KIND_INTERNAL) && VolumeNeedsScan(Volume))
                ScanLegacyVolume(Volume, VolumeIndex);
        } // for
-    } else if (GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) {
+    } else if ((GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) && !OnlyNewVolumes) {
        // TODO: This actually picks up USB flash drives, too; try to find
        // a way to differentiate the two....
        ScanLegacyUEFI(BBS_HARDDISK);
@@ -2060,10 +2185,10 @@ static VOID ScanLegacyExternal(VOID)
    if (GlobalConfig.LegacyType == LEGACY_TYPE_MAC) {
       for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
          Volume = Volumes[VolumeIndex];
-         if (Volume->DiskKind == DISK_KIND_EXTERNAL)
+         if ((Volume->DiskKind == DISK_KIND_EXTERNAL) && VolumeNeedsScan(Volume))
             ScanLegacyVolume(Volume, VolumeIndex);
       } // for
-   } else if (GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) {
+   } else if ((GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) && !OnlyNewVolumes) {
       // TODO: This actually doesn't do anything useful; leaving in hopes of
       // fixing it later....
       ScanLegacyUEFI(BBS_USB);
@@ -2138,71 +2263,34 @@ static UINTN ScanDriverDir(IN CHAR16 *Path)
 }
 
 #ifdef __MAKEWITH_GNUEFI
+// Connect every device handle that isn't the child of another (connecting
+// the top-level controllers recursively takes care of their children).
 static EFI_STATUS ConnectAllDriversToAllControllers(VOID)
 {
     EFI_STATUS           Status;
-    UINTN                AllHandleCount;
-    EFI_HANDLE           *AllHandleBuffer;
-    UINTN                Index;
     UINTN                HandleCount;
     EFI_HANDLE           *HandleBuffer;
     UINT32               *HandleType;
-    UINTN                HandleIndex;
-    BOOLEAN              Parent;
-    BOOLEAN              Device;
-
-    Status = LibLocateHandle(AllHandles,
-                             NULL,
-                             NULL,
-                             &AllHandleCount,
-                             &AllHandleBuffer);
+    UINTN                Index;
+
+    Status = LibClassifyHandleDatabase(&HandleCount, &HandleBuffer, &HandleType);
     if (EFI_ERROR(Status))
         return Status;
 
-    for (Index = 0; Index < AllHandleCount; Index++) {
-        //
-        // Scan the handle database
-        //
-        Status = LibScanHandleDatabase(NULL,
-                                       NULL,
-                                       AllHandleBuffer[Index],
-                                       NULL,
-                                       &HandleCount,
-                                       &HandleBuffer,
-                                       &HandleType);
-        if (EFI_ERROR (Status))
-            goto Done;
-
-        Device = TRUE;
-        if (HandleType[Index] & EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE)
-            Device = FALSE;
-        if (HandleType[Index] & EFI_HANDLE_TYPE_IMAGE_HANDLE)
-            Device = FALSE;
-
-        if (Device) {
-            Parent = FALSE;
-            for (HandleIndex = 0; HandleIndex < HandleCount; HandleIndex++) {
-                if (HandleType[HandleIndex] & EFI_HANDLE_TYPE_PARENT_HANDLE)
-                    Parent = TRUE;
-            } // for
-
-            if (!Parent) {
-                if (HandleType[Index] & EFI_HANDLE_TYPE_DEVICE_HANDLE) {
-                   Status = refit_call4_wrapper(BS->ConnectController,
-                                                AllHandleBuffer[Index],
-                                                NULL,
-                                                NULL,
-                                                TRUE);
-                }
-            }
+    for (Index = 0; Index < HandleCount; Index++) {
+        if ((HandleType[Index] & EFI_HANDLE_TYPE_DEVICE_HANDLE) &&
+            !(HandleType[Index] & (EFI_HANDLE_TYPE_DRIVER_BINDING_HANDLE | EFI_HANDLE_TYPE_IMAGE_HANDLE |
+                                   EFI_HANDLE_TYPE_CHILD_HANDLE))) {
+            Status = refit_call4_wrapper(BS->ConnectController,
+                                         HandleBuffer[Index],
+                                         NULL,
+                                         NULL,
+                                         TRUE);
         }
-
-        MyFreePool (HandleBuffer);
-        MyFreePool (HandleType);
     }
 
-Done:
-    MyFreePool (AllHandleBuffer);
+    MyFreePool (HandleBuffer);
+    MyFreePool (HandleType);
     return Status;
 } /* EFI_STATUS ConnectAllDriversToAllControllers() */
 #else
@@ -2212,13 +2300,59 @@ static EFI_STATUS ConnectAllDriversToAllControllers(VOID) {
 }
 #endif
 
+// Connect the drivers that weren't among the OldCount driver binding handles
+// in OldDrivers (that is, those loaded since that list was made) to every
+// BlockIO device that doesn't yet have a filesystem, without recursing to
+// child controllers. This takes time in proportion to the number of disks,
+// rather than the number of devices as ConnectAllDriversToAllControllers()
+// does, but it's suitable only for filesystem drivers.
+static VOID ConnectNewDriversToDisks(IN EFI_HANDLE *OldDrivers, IN UINTN OldCount)
+{
+    EFI_STATUS    Status;
+    EFI_HANDLE    *Drivers = NULL, *NewDrivers, *Handles = NULL;
+    VOID          *FileSystem;
+    UINTN         DriverCount = 0, NewCount = 0, HandleCount = 0, i, j;
+
+    Status = LibLocateHandle(ByProtocol, &gEfiDriverBindingProtocolGuid, NULL, &DriverCount, &Drivers);
+    if (EFI_ERROR(Status))
+        return;
+
+    // Keep only the new drivers, NULL-terminated as ConnectController() wants
+    NewDrivers = AllocateZeroPool((DriverCount + 1) * sizeof(EFI_HANDLE));
+    if (NewDrivers != NULL) {
+        for (i = 0; i < DriverCount; i++) {
+            for (j = 0; (j < OldCount) && (OldDrivers[j] != Drivers[i]); j++)
+                ;
+            if (j == OldCount)
+                NewDrivers[NewCount++] = Drivers[i];
+        } // for
+    } // if
+    MyFreePool(Drivers);
+
+    if (NewCount > 0)
+        Status = LibLocateHandle(ByProtocol, &BlockIoProtocol, NULL, &HandleCount, &Handles);
+    if ((NewCount > 0) && !EFI_ERROR(Status)) {
+        for (i = 0; i < HandleCount; i++) {
+            Status = refit_call3_wrapper(BS->HandleProtocol, Handles[i], &FileSystemProtocol, &FileSystem);
+            if (EFI_ERROR(Status))
+                refit_call4_wrapper(BS->ConnectController, Handles[i], NewDrivers, NULL, FALSE);
+        } // for
+        MyFreePool(Handles);
+    } // if
+    MyFreePool(NewDrivers);
+} // static VOID ConnectNewDriversToDisks()
+
 // Load all EFI drivers from rEFInd's "drivers" subdirectory and from the
 // directories specified by the user in the "scan_driver_dirs" configuration
 // file line.
 static VOID LoadDrivers(VOID)
 {
     CHAR16        *Directory, *SelfDirectory;
-    UINTN         i = 0, Length, NumFound = 0;
+    UINTN         i = 0, Length, NumFound = 0, OldCount = 0;
+    EFI_HANDLE    *OldDrivers = NULL;
+
+    if (GlobalConfig.TargetedDriverConnect)
+        LibLocateHandle(ByProtocol, &gEfiDriverBindingProtocolGuid, NULL, &OldCount, &OldDrivers);
 
     // load drivers from the subdirectories of rEFInd's home directory specified
     // in the DRIVER_DIRS constant.
@@ -2243,8 +2377,13 @@ static VOID LoadDrivers(VOID)
     } // while
 
     // connect all devices
-    if (NumFound > 0)
-       ConnectAllDriversToAllControllers();
+    if (NumFound > 0) {
+       if (GlobalConfig.TargetedDriverConnect)
+          ConnectNewDriversToDisks(OldDrivers, OldCount);
+       else
+          ConnectAllDriversToAllControllers();
+    } // if
+    MyFreePool(OldDrivers);
 } /* static VOID LoadDrivers() */
 
 // Determine what (if any) type of legacy (BIOS) boot support is available
@@ -2291,6 +2430,17 @@ static VOID WarnIfLegacyProblems(VOID) {
    } // if no legacy support
 } // static VOID WarnIfLegacyProblems()
 
+// Give the first nine entries in the first row of the main menu the shortcut
+// keys 1-9.
+static VOID AssignShortcutDigits(VOID) {
+   UINTN i;
+
+   for (i = 0; i < MainMenu.EntryCount; i++)
+      MainMenu.Entries[i]->ShortcutDigit = 0;
+   for (i = 0; i < MainMenu.EntryCount && MainMenu.Entries[i]->Row == 0 && i < 9; i++)
+      MainMenu.Entries[i]->ShortcutDigit = (CHAR16)('1' + i);
+} // static VOID AssignShortcutDigits()
+
 // Locates boot loaders. NOTE: This assumes that GlobalConfig.LegacyType is set correctly.
 static VOID ScanForBootloaders(VOID) {
    UINTN    i;
@@ -2305,7 +2455,7 @@ static VOID ScanForBootloaders(VOID) {
    } // for
 
    // If UEFI & scanning for legacy loaders & deep legacy scan, update NVRAM boot manager list
-   if ((GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) && ScanForLegacy && GlobalConfig.DeepLegacyScan) {
+   if ((GlobalConfig.LegacyType == LEGACY_TYPE_UEFI) && ScanForLegacy && GlobalConfig.DeepLegacyScan && !OnlyNewVolumes) {
       BdsDeleteAllInvalidLegacyBootOptions();
       BdsAddNonExistingLegacyBootOptions();
    } // if
@@ -2323,7 +2473,8 @@ static VOID ScanForBootloaders(VOID) {
             ScanLegacyExternal();
             break;
          case 'm': case 'M':
-            ScanUserConfigured(GlobalConfig.ConfigFilename);
+            if (!OnlyNewVolumes)
+               ScanUserConfigured(GlobalConfig.ConfigFilename);
             break;
          case 'e': case 'E':
             ScanExternal();
@@ -2337,9 +2488,9 @@ static VOID ScanForBootloaders(VOID) {
       } // switch()
    } // for
 
-   // assign shortcut keys
-   for (i = 0; i < MainMenu.EntryCount && MainMenu.Entries[i]->Row == 0 && i < 9; i++)
-      MainMenu.Entries[i]->ShortcutDigit = (CHAR16)('1' + i);
+   AssignShortcutDigits();
+
+   FreeLinuxOptionsCache();
 
    // wait for user ACK when there were errors
    FinishTextScreen(FALSE);
@@ -2350,6 +2501,7 @@ static VOID ScanForBootloaders(VOID) {
 static VOID FindTool(CHAR16 *Locations, CHAR16 *Names, CHAR16 *Description, UINTN Icon) {
    UINTN j = 0, k, VolumeIndex;
    CHAR16 *DirName, *FileName, *PathName, FullDescription[256];
+   LOADER_ENTRY *Entry;
 
    while ((DirName = FindCommaDelimited(Locations, j++)) != NULL) {
       k = 0;
@@ -2357,9 +2509,11 @@ static VOID FindTool(CHAR16 *Locations, CHAR16 *Names, CHAR16 *Description, UINT
          PathName = StrDuplicate(DirName);
          MergeStrings(&PathName, FileName, (StriCmp(PathName, L"\\") == 0) ? 0 : L'\\');
          for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-            if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, PathName))) {
+            if ((Volumes[VolumeIndex]->RootDir != NULL) && VolumeNeedsScan(Volumes[VolumeIndex]) &&
+                (FileExists(Volumes[VolumeIndex]->RootDir, PathName))) {
                SPrint(FullDescription, 255, L"%s at %s on %s", Description, PathName, Volumes[VolumeIndex]->VolName);
-               AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, PathName, FullDescription, BuiltinIcon(Icon), 'S', FALSE);
+               Entry = AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, PathName, FullDescription, BuiltinIcon(Icon), 'S', FALSE);
+               Entry->Volume = Volumes[VolumeIndex];
             } // if
          } // for
          MyFreePool(PathName);
@@ -2374,6 +2528,7 @@ static VOID FindTool(CHAR16 *Locations, CHAR16 *Names, CHAR16 *Description, UINT
 static VOID ScanForTools(VOID) {
    CHAR16 *FileName = NULL, *VolName = NULL, *MokLocations, Description[256];
    REFIT_MENU_ENTRY *TempMenuEntry;
+   LOADER_ENTRY *Entry;
    UINTN i, j, VolumeIndex;
    UINT64 osind;
    CHAR8 *b = 0;
@@ -2383,6 +2538,10 @@ static VOID ScanForTools(VOID) {
       MergeStrings(&MokLocations, SelfDirPath, L',');
 
    for (i = 0; i < NUM_TOOLS; i++) {
+      // Only tools that are searched for on every volume can turn up on a new one
+      if (OnlyNewVolumes && (GlobalConfig.ShowTools[i] != TAG_APPLE_RECOVERY) && (GlobalConfig.ShowTools[i] != TAG_WINDOWS_RECOVERY) &&
+          (GlobalConfig.ShowTools[i] != TAG_MOK_TOOL) && (GlobalConfig.ShowTools[i] != TAG_MEMTEST))
+         continue;
       switch(GlobalConfig.ShowTools[i]) {
          // NOTE: Be sure that FileName is NULL at the end of each case.
          case TAG_SHUTDOWN:
@@ -2458,10 +2617,12 @@ static VOID ScanForTools(VOID) {
          case TAG_APPLE_RECOVERY:
             FileName = StrDuplicate(L"\\com.apple.recovery.boot\\boot.efi");
             for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-               if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, FileName))) {
+               if ((Volumes[VolumeIndex]->RootDir != NULL) && VolumeNeedsScan(Volumes[VolumeIndex]) &&
+                   (FileExists(Volumes[VolumeIndex]->RootDir, FileName))) {
                   SPrint(Description, 255, L"Apple Recovery on %s", Volumes[VolumeIndex]->VolName);
-                  AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
-                               BuiltinIcon(BUILTIN_ICON_TOOL_APPLE_RESCUE), 'R', TRUE);
+                  Entry = AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
+                                       BuiltinIcon(BUILTIN_ICON_TOOL_APPLE_RESCUE), 'R', TRUE);
+                  Entry->Volume = Volumes[VolumeIndex];
                } // if
             } // for
             MyFreePool(FileName);
@@ -2473,11 +2634,13 @@ static VOID ScanForTools(VOID) {
             while ((FileName = FindCommaDelimited(GlobalConfig.WindowsRecoveryFiles, j++)) != NULL) {
                SplitVolumeAndFilename(&FileName, &VolName);
                for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
-                  if ((Volumes[VolumeIndex]->RootDir != NULL) && (FileExists(Volumes[VolumeIndex]->RootDir, FileName)) &&
+                  if ((Volumes[VolumeIndex]->RootDir != NULL) && VolumeNeedsScan(Volumes[VolumeIndex]) &&
+                      (FileExists(Volumes[VolumeIndex]->RootDir, FileName)) &&
                       ((VolName == NULL) || (StriCmp(VolName, Volumes[VolumeIndex]->VolName) == 0))) {
                      SPrint(Description, 255, L"Microsoft Recovery on %s", Volumes[VolumeIndex]->VolName);
-                     AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
-                                  BuiltinIcon(BUILTIN_ICON_TOOL_WINDOWS_RESCUE), 'R', TRUE);
+                     Entry = AddToolEntry(Volumes[VolumeIndex]->DeviceHandle, FileName, Description,
+                                          BuiltinIcon(BUILTIN_ICON_TOOL_WINDOWS_RESCUE), 'R', TRUE);
+                     Entry->Volume = Volumes[VolumeIndex];
                   } // if
                } // for
             } // while
@@ -2513,13 +2676,93 @@ static VOID RescanAll(BOOLEAN DisplayMessage) {
    MainMenu.Entries = NULL;
    MainMenu.EntryCount = 0;
    ReadConfig(GlobalConfig.ConfigFilename);
+   BuildDontScanLists();
    ConnectAllDriversToAllControllers();
+   NewVolumesAppeared(); // ignore the volumes we just connected ourselves
+   FreeVolumes(); // the new configuration may call for different icons
    ScanVolumes();
    ScanForBootloaders();
    ScanForTools();
    SetupScreen();
 } // VOID RescanAll()
 
+// Returns TRUE if Entry belongs to a volume that the latest ScanVolumes() call
+// dropped or replaced. Such a volume has already been freed, so its address is
+// compared with the current volumes but never dereferenced unless it's among
+// them.
+static BOOLEAN EntryVolumeGone(REFIT_MENU_ENTRY *Entry) {
+   REFIT_VOLUME *Volume = NULL;
+   UINTN        VolumeIndex;
+
+   if ((Entry->Tag == TAG_LOADER) || (Entry->Tag == TAG_TOOL))
+      Volume = ((LOADER_ENTRY *) Entry)->Volume;
+   else if (Entry->Tag == TAG_LEGACY)
+      Volume = ((LEGACY_ENTRY *) Entry)->Volume;
+   if (Volume == NULL)
+      return FALSE;
+
+   for (VolumeIndex = 0; VolumeIndex < VolumesCount; VolumeIndex++) {
+      if (Volumes[VolumeIndex] == Volume)
+         return Volume->IsNew; // if new, the old volume's memory has been reused
+   } // for
+   return TRUE;
+} // static BOOLEAN EntryVolumeGone()
+
+// Rescan after a disk has been plugged in or removed. Unlike RescanAll(), this
+// doesn't re-read the configuration file, and it keeps the menu entries (and
+// their icons) for volumes that haven't changed, searching for boot loaders and
+// tools only on the volumes that ScanVolumes() has just probed. Manual boot
+// stanzas and firmware (UEFI-style legacy) boot options aren't updated until
+// the next full rescan.
+static VOID RescanNewVolumes(VOID) {
+   REFIT_MENU_ENTRY **Entries;
+   UINTN            i, EntryCount = 0;
+
+   ConnectAllDriversToAllControllers();
+   NewVolumesAppeared(); // ignore the volumes we just connected ourselves
+   ScanVolumes();
+
+   // Drop the entries for volumes that have gone away....
+   for (i = 0; i < MainMenu.EntryCount; i++) {
+      if (EntryVolumeGone(MainMenu.Entries[i]))
+         MyFreePool(MainMenu.Entries[i]);
+      else
+         MainMenu.Entries[EntryCount++] = MainMenu.Entries[i];
+   } // for
+   MainMenu.EntryCount = EntryCount;
+   if (EntryCount == 0) {
+      MyFreePool(MainMenu.Entries);
+      MainMenu.Entries = NULL;
+   }
+
+   // ....add those for new ones....
+   OnlyNewVolumes = TRUE;
+   ScanForBootloaders();
+   ScanForTools();
+   OnlyNewVolumes = FALSE;
+
+   // ....and move the new boot loaders ahead of the tools, which are all in
+   // the second row.
+   if (MainMenu.EntryCount > 0) {
+      Entries = AllocatePool(sizeof(REFIT_MENU_ENTRY *) * MainMenu.EntryCount);
+      if (Entries != NULL) {
+         EntryCount = 0;
+         for (i = 0; i < MainMenu.EntryCount; i++) {
+            if (MainMenu.Entries[i]->Row == 0)
+               Entries[EntryCount++] = MainMenu.Entries[i];
+         }
+         for (i = 0; i < MainMenu.EntryCount; i++) {
+            if (MainMenu.Entries[i]->Row != 0)
+               Entries[EntryCount++] = MainMenu.Entries[i];
+         }
+         CopyMem(MainMenu.Entries, Entries, sizeof(REFIT_MENU_ENTRY *) * MainMenu.EntryCount);
+         MyFreePool(Entries);
+      } // if
+   } // if
+   AssignShortcutDigits();
+   SetupScreen();
+} // static VOID RescanNewVolumes()
+
 #ifdef __MAKEWITH_TIANO
 
 // Minimal initialization function
@@ -2630,6 +2873,7 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
        CopyMem(GlobalConfig.ScanFor, "ihebocm   ", NUM_SCAN_OPTIONS);
     SetConfigFilename(ImageHandle);
     ReadConfig(GlobalConfig.ConfigFilename);
+    BuildDontScanLists();
 
     InitScreen();
     WarnIfLegacyProblems();
@@ -2641,6 +2885,7 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
     // further bootstrap (now with config available)
     MokProtocol = SecureBootSetup();
     LoadDrivers();
+    WatchForNewVolumes();
     ScanVolumes();
     ScanForBootloaders();
     ScanForTools();
@@ -2671,6 +2916,13 @@ efi_main (EFI_HANDLE ImageHandle, EFI_SYSTEM_TABLE *SystemTable)
             continue;
         }
 
+        // ....as does plugging in a new disk
+        if (MenuExit == MENU_EXIT_HOTPLUG) {
+            MenuExit = 0;
+            RescanNewVolumes();
+            continue;
+        }
+
         switch (ChosenEntry->Tag) {
 
             case TAG_REBOOT:    // Reboot
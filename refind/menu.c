@@ -349,15 +349,28 @@ static VOID SaveScreen(VOID) {
    ReadAllKeyStrokes();
 } // VOID SaveScreen()
 
+// Wait for new volumes to stop appearing (a USB flash drive's whole-disk,
+// partition, and filesystem protocols all arrive in quick succession), for
+// at most two seconds.
+static VOID WaitForVolumesToSettle(VOID) {
+   UINTN i = 0;
+
+   do {
+      refit_call1_wrapper(BS->Stall, 250000);
+   } while (NewVolumesAppeared() && (++i < 8));
+} // static VOID WaitForVolumesToSettle()
+
 //
 // generic menu function
+// If WatchVolumes is TRUE, return MENU_EXIT_HOTPLUG when a new disk appears.
 //
 static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC StyleFunc, IN OUT INTN *DefaultEntryIndex,
-                            OUT REFIT_MENU_ENTRY **ChosenEntry)
+                            OUT REFIT_MENU_ENTRY **ChosenEntry, IN BOOLEAN WatchVolumes)
 {
     SCROLL_STATE State;
     EFI_STATUS Status;
     EFI_INPUT_KEY key;
+    EFI_EVENT WaitList[2];
     UINTN index;
     INTN ShortcutEntry;
     BOOLEAN HaveTimeout = FALSE;
@@ -373,6 +386,8 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
         TimeoutCountdown = Screen->TimeoutSeconds * 10;
     }
     MenuExit = 0;
+    if (NewVolumeEvent == NULL)
+        WatchVolumes = FALSE;
 
     StyleFunc(Screen, &State, MENU_FUNCTION_INIT, NULL);
     IdentifyRows(&State, Screen);
@@ -440,7 +455,10 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
         // read key press (and wait for it if applicable)
         Status = refit_call2_wrapper(ST->ConIn->ReadKeyStroke, ST->ConIn, &key);
         if (Status != EFI_SUCCESS) {
-            if (HaveTimeout && TimeoutCountdown == 0) {
+            if (WatchVolumes && NewVolumesAppeared()) {
+                MenuExit = MENU_EXIT_HOTPLUG;
+                break;
+            } else if (HaveTimeout && TimeoutCountdown == 0) {
                 // timeout expired
                 MenuExit = MENU_EXIT_TIMEOUT;
                 break;
@@ -457,7 +475,15 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
                    TimeSinceKeystroke = 0;
                 } // if
             } else {
-                refit_call3_wrapper(BS->WaitForEvent, 1, &ST->ConIn->WaitForKey, &index);
+                // waiting resets NewVolumeEvent, so check which event fired
+                WaitList[0] = ST->ConIn->WaitForKey;
+                WaitList[1] = NewVolumeEvent;
+                index = 0;
+                refit_call3_wrapper(BS->WaitForEvent, WatchVolumes ? 2 : 1, WaitList, &index);
+                if (index == 1) {
+                    MenuExit = MENU_EXIT_HOTPLUG;
+                    break;
+                }
             }
             continue;
         } else {
@@ -537,6 +563,12 @@ static UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC Sty
         }
     }
 
+    if (MenuExit == MENU_EXIT_HOTPLUG) {
+        WaitForVolumesToSettle();
+        // resume any timeout where it left off once the menu is rebuilt
+        Screen->TimeoutSeconds = HaveTimeout ? (TimeoutCountdown + 9) / 10 : 0;
+    }
+
     StyleFunc(Screen, &State, MENU_FUNCTION_CLEANUP, NULL);
 
     if (ChosenEntry)
@@ -1018,17 +1050,18 @@ static VOID PaintSelection(IN REFIT_MENU_SCREEN *Screen, IN SCROLL_STATE *State,
 // edge if Alignment == ALIGN_LEFT, and along the right edge if
 // Alignment == ALIGN_RIGHT
 static VOID PaintIcon(IN EG_EMBEDDED_IMAGE *BuiltInIcon, IN CHAR16 *ExternalFilename, UINTN PosX, UINTN PosY, UINTN Alignment) {
-   EG_IMAGE *Icon = NULL;
+   EG_IMAGE *Icon = NULL, *ExternalIcon;
 
-   Icon = egFindIcon(ExternalFilename, GlobalConfig.IconSizes[ICON_SIZE_SMALL]);
+   Icon = ExternalIcon = egFindIcon(ExternalFilename, GlobalConfig.IconSizes[ICON_SIZE_SMALL]);
    if (Icon == NULL)
-      Icon = egPrepareEmbeddedImage(BuiltInIcon, TRUE);
+      Icon = egGetEmbeddedImage(BuiltInIcon, TRUE);
    if (Icon != NULL) {
       if (Alignment == ALIGN_RIGHT)
          PosX -= Icon->Width;
       egDrawImageWithTransparency(Icon, NULL, PosX, PosY - (Icon->Height / 2), Icon->Width, Icon->Height);
    }
-} // static VOID ()
+   egFreeImage(ExternalIcon);
+} // static VOID PaintIcon()
 
 inline UINTN ComputeRow0PosY(VOID) {
    return ((UGAHeight / 2) - TileSizes[0] / 2);
@@ -1185,7 +1218,7 @@ UINTN RunMenu(IN REFIT_MENU_SCREEN *Screen, OUT REFIT_MENU_ENTRY **ChosenEntry)
     if (AllowGraphicsMode)
         Style = GraphicsMenuStyle;
 
-    return RunGenericMenu(Screen, Style, &DefaultEntry, ChosenEntry);
+    return RunGenericMenu(Screen, Style, &DefaultEntry, ChosenEntry, FALSE);
 }
 
 UINTN RunMainMenu(REFIT_MENU_SCREEN *Screen, CHAR16** DefaultSelection, REFIT_MENU_ENTRY **ChosenEntry)
@@ -1212,13 +1245,14 @@ UINTN RunMainMenu(REFIT_MENU_SCREEN *Screen, CHAR16** DefaultSelection, REFIT_ME
     }
 
     while (!MenuExit) {
-        MenuExit = RunGenericMenu(Screen, MainStyle, &DefaultEntryIndex, &TempChosenEntry);
-        Screen->TimeoutSeconds = 0;
+        MenuExit = RunGenericMenu(Screen, MainStyle, &DefaultEntryIndex, &TempChosenEntry, TRUE);
+        if (MenuExit != MENU_EXIT_HOTPLUG)
+            Screen->TimeoutSeconds = 0;
 
         MenuTitle = StrDuplicate(TempChosenEntry->Title);
         if (MenuExit == MENU_EXIT_DETAILS) {
             if (TempChosenEntry->SubScreen != NULL) {
-               MenuExit = RunGenericMenu(TempChosenEntry->SubScreen, Style, &DefaultSubmenuIndex, &TempChosenEntry);
+               MenuExit = RunGenericMenu(TempChosenEntry->SubScreen, Style, &DefaultSubmenuIndex, &TempChosenEntry, FALSE);
                if (MenuExit == MENU_EXIT_ESCAPE || TempChosenEntry->Tag == TAG_RETURN)
                    MenuExit = 0;
                if (MenuExit == MENU_EXIT_DETAILS) {
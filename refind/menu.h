@@ -64,6 +64,7 @@
 #define MENU_EXIT_DETAILS (3)
 #define MENU_EXIT_TIMEOUT (4)
 #define MENU_EXIT_EJECT   (5)
+#define MENU_EXIT_HOTPLUG (6)
 
 #define TAG_RETURN       (99)
 
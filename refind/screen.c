@@ -437,8 +437,10 @@ VOID BltClearScreen(BOOLEAN ShowBanner)
 {
     static EG_IMAGE *Banner = NULL;
     EG_IMAGE *NewBanner = NULL;
-    INTN BannerPosX, BannerPosY;
+    INTN BannerPosX = 0, BannerPosY = 0;
     EG_PIXEL Black = { 0x0, 0x0, 0x0, 0 };
+    EG_PIXEL *FillColor = &MenuBackgroundPixel;
+    BOOLEAN DrawBanner = FALSE;
 
     if (ShowBanner && !(GlobalConfig.HideUIFlags & HIDEUI_FLAG_BANNER)) {
         // load banner on first call
@@ -459,17 +461,14 @@ VOID BltClearScreen(BOOLEAN ShowBanner)
                                       (Banner->Height > UGAHeight) ? UGAHeight : Banner->Height);
            } // if/elseif
            if (NewBanner) {
-              MyFreePool(Banner);
+              egFreeImage(Banner);
               Banner = NewBanner;
            }
            MenuBackgroundPixel = Banner->PixelData[0];
         } // if Banner exists
 
-        // clear and draw banner
-        if (GlobalConfig.ScreensaverTime != -1)
-           egClearScreen(&MenuBackgroundPixel);
-        else
-           egClearScreen(&Black);
+        if (GlobalConfig.ScreensaverTime == -1)
+           FillColor = &Black;
 
         if (Banner != NULL) {
             BannerPosX = (Banner->Width < UGAWidth) ? ((UGAWidth - Banner->Width) / 2) : 0;
@@ -477,18 +476,26 @@ VOID BltClearScreen(BOOLEAN ShowBanner)
             if (BannerPosY < 0)
                BannerPosY = 0;
             GlobalConfig.BannerBottomEdge = BannerPosY + Banner->Height;
-            if (GlobalConfig.ScreensaverTime != -1)
-               BltImage(Banner, (UINTN) BannerPosX, (UINTN) BannerPosY);
+            DrawBanner = (GlobalConfig.ScreensaverTime != -1);
         }
+    } // if showing banner
 
-    } else { // not showing banner
-        // clear to menu background color
-        egClearScreen(&MenuBackgroundPixel);
+    // Compose the background in system memory and keep that as the authoritative
+    // copy of the screen, rather than reading the screen back after drawing it;
+    // reads from the frame buffer can be very slow.
+    egFreeImage(GlobalConfig.ScreenBackground);
+    GlobalConfig.ScreenBackground = egCreateFilledImage(UGAWidth, UGAHeight, FALSE, FillColor);
+    if (GlobalConfig.ScreenBackground != NULL) {
+        if (DrawBanner)
+            egComposeImage(GlobalConfig.ScreenBackground, Banner, (UINTN) BannerPosX, (UINTN) BannerPosY);
+        egDrawImage(GlobalConfig.ScreenBackground, 0, 0);
+    } else {
+        egClearScreen(FillColor);
+        if (DrawBanner)
+            egDrawImage(Banner, (UINTN) BannerPosX, (UINTN) BannerPosY);
     }
 
     GraphicsScreenDirty = FALSE;
-    egFreeImage(GlobalConfig.ScreenBackground);
-    GlobalConfig.ScreenBackground = egCopyScreen();
 } // VOID BltClearScreen()
 
 